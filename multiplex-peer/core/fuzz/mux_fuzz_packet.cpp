@@ -0,0 +1,166 @@
+#include "../mux_delta_runs.h"
+#include "../mux_router.h"
+#include "../mux_session.h"
+#include "../mux_wire.h"
+#include "../tests/mux_test_fixtures.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// libFuzzer entry point for everything a host peer's packet goes through: validation, peeking, header and
+// command parsing, the routing decision, delta decoding, and a server and a client session receiving it.
+// Build it with `scons core_fuzz`, the core tests also run it over mutated packets.
+
+static void check_route(const uint8_t *data, uint32_t size, int32_t sender_host_peer, bool forwarding) {
+	static const MuxTestDirectory directory;
+	MuxRoute route;
+	if (mux_route_data(data, size, sender_host_peer, forwarding, directory, route) != MUX_OK) {
+		return;
+	}
+	int32_t owner;
+	if (!directory.get_subpeer_owner(route.source, owner) || owner != sender_host_peer) {
+		abort();
+	}
+	if (route.action == MUX_ROUTE_FORWARD && (!forwarding || route.host_peer == sender_host_peer || route.host_peer == MUX_HOST_PEER_AWAY)) {
+		abort();
+	}
+	if (route.action == MUX_ROUTE_FORWARD_AND_DELIVER && !forwarding) {
+		abort();
+	}
+}
+
+static uint8_t decoded[MAX_MULTIPLEX_PACKET_SIZE];
+static uint8_t encoded[MAX_MULTIPLEX_PACKET_SIZE];
+static uint8_t redecoded[MAX_MULTIPLEX_PACKET_SIZE];
+
+// Decoding must stay inside its buffers whatever it is given, and what decodes has to survive a round trip
+static void check_delta_runs(const uint8_t *body, uint32_t length, const uint8_t *baseline, uint32_t baseline_length, uint32_t decoded_length) {
+	if (!mux_delta_decode_runs(body, length, baseline, baseline_length, decoded, decoded_length)) {
+		return;
+	}
+	uint32_t written;
+	if (!mux_delta_encode_runs(decoded, decoded_length, baseline, baseline_length, encoded, written)) {
+		return;
+	}
+	if ((decoded_length != 0 && written >= decoded_length) || !mux_delta_decode_runs(encoded, written, baseline, baseline_length, redecoded, decoded_length) || memcmp(decoded, redecoded, decoded_length) != 0) {
+		abort();
+	}
+}
+
+// Encoding one half of the input against the other has to decode back to it
+static void check_delta_round_trip(const uint8_t *data, uint32_t size) {
+	uint32_t baseline_length = size / 2;
+	const uint8_t *payload = data + baseline_length;
+	uint32_t length = size - baseline_length;
+	uint32_t written;
+	if (!mux_delta_encode_runs(payload, length, data, baseline_length, encoded, written)) {
+		return;
+	}
+	if ((length != 0 && written >= length) || !mux_delta_decode_runs(encoded, written, data, baseline_length, redecoded, length) || memcmp(payload, redecoded, length) != 0) {
+		abort();
+	}
+}
+
+// Sets up a session that knows the subpeers of MuxTestDirectory and feeds it the packet.
+// Whatever the packet does, everything the session sends in reaction has to be well formed.
+static void check_session(const uint8_t *data, uint32_t size, bool server) {
+	MuxTestTransport transport;
+	MuxTestListener listener;
+	MuxSession session(listener);
+	session.set_header_forwarding(true);
+	session.set_delta_encoding(true);
+	session.set_resume_grace_period_msec(1000);
+	session.set_session_id(7);
+	transport.unique_id = server ? 1 : 10;
+	session.attach(&transport);
+	uint8_t command_packet[MULTIPLEX_CMD_MAX_SIZE];
+	MultiplexPacketCommand command;
+	memset(&command, 0, sizeof(command));
+	if (server) {
+		session.add_local_subpeer(1);
+		command.subtype = MUX_CMD_ADD_PEER;
+		const int32_t subpeers[3] = { 2, 3, 4 };
+		const int32_t owners[3] = { 10, 10, 11 };
+		for (int i = 0; i < 3; i++) {
+			command.subject_multiplex_peer = subpeers[i];
+			uint32_t command_size = mux_write_command(command_packet, MUX_TRANSFER_MODE_RELIABLE, 7, command);
+			session.receive(owners[i], 1, command_packet, command_size);
+		}
+	}
+	else {
+		session.add_local_subpeer(2);
+		session.host_peer_connected(1);
+		command.subtype = MUX_CMD_ADD_PEER_ACK;
+		command.subject_multiplex_peer = 2;
+		uint32_t command_size = mux_write_command(command_packet, MUX_TRANSFER_MODE_RELIABLE, 7, command);
+		session.receive(1, 1, command_packet, command_size);
+		command.subtype = MUX_CMD_ADD_PEER;
+		command.subject_multiplex_peer = 4;
+		command_size = mux_write_command(command_packet, MUX_TRANSFER_MODE_RELIABLE, 7, command);
+		session.receive(1, 1, command_packet, command_size);
+	}
+	session.receive(server ? 10 : 1, 0, data, size);
+	if (server) {
+		session.receive(11, 0, data, size);
+		session.host_peer_disconnected(10);
+	}
+	for (uint32_t i = 0; i < transport.sent.size(); i++) {
+		if (mux_validate(transport.sent[i].data.ptr(), transport.sent[i].data.size()) != MUX_OK) {
+			abort();
+		}
+	}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if (size > MAX_MULTIPLEX_PACKET_SIZE) {
+		return 0;
+	}
+	uint32_t length = (uint32_t)size;
+	check_delta_round_trip(data, length);
+	check_delta_runs(data, length, data, length / 2, length * 2 < sizeof(decoded) ? length * 2 : sizeof(decoded));
+	if (mux_validate(data, length) != MUX_OK) {
+		return 0;
+	}
+	// anything that passes validation has to be readable, and write back to the same bytes
+	uint16_t session;
+	if (mux_peek_session(data, length, session) != MUX_OK) {
+		abort();
+	}
+	if (data[0] == MUX_CMD) {
+		MultiplexPacketCommand command;
+		if (mux_read_command(data, length, command) != MUX_OK) {
+			abort();
+		}
+		uint8_t out[MULTIPLEX_CMD_MAX_SIZE];
+		if (mux_write_command(out, data[1], session, command) != length || memcmp(out, data, length) != 0) {
+			abort();
+		}
+		check_session(data, length, true);
+		check_session(data, length, false);
+		return 0;
+	}
+	MultiplexPacketData header;
+	if (mux_read_data_header(data, length, header) != MUX_OK) {
+		abort();
+	}
+	uint8_t out[MULTIPLEX_DELTA_HEADER_SIZE];
+	uint32_t header_size = mux_write_data_header(out, data[0], data[1], session, header);
+	if (header_size != mux_get_data_header_size(data[0]) || memcmp(out, data, header_size) != 0) {
+		abort();
+	}
+	uint16_t sequence;
+	if ((mux_peek_sequence(data, length, sequence) == MUX_OK) != (data[0] != MUX_DATA)) {
+		abort();
+	}
+	check_route(data, length, 10, true);
+	check_route(data, length, 10, false);
+	check_route(data, length, 11, true);
+	if (data[0] == MUX_DATA_DELTA) {
+		// the body against a baseline of the same stream that may be shorter or longer than the result
+		check_delta_runs(data + header_size, header.length, data, header_size, header.decoded_length);
+	}
+	check_session(data, length, true);
+	check_session(data, length, false);
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include "mux_delta.h"
+#include "mux_delta_runs.h"
+#include <cstring>
+
+MuxArray<uint8_t> &MuxDeltaCodec::History::store(uint16_t sequence) {
+  uint32_t slot = sequence % MUX_DELTA_HISTORY;
+  sequences[slot] = sequence;
+  valid[slot] = true;
+  return payloads[slot];
+}
+
+const MuxArray<uint8_t> *MuxDeltaCodec::History::find(uint16_t sequence) const {
+  uint32_t slot = sequence % MUX_DELTA_HISTORY;
+  if (!valid[slot] || sequences[slot] != sequence) {
+    return nullptr;
+  }
+  return &payloads[slot];
+}
+
+MuxDeltaCodec::~MuxDeltaCodec() {
+  clear();
+}
+
+void MuxDeltaCodec::encode(const MuxStreamKey &key, const uint8_t *payload, uint32_t length, uint16_t sequence, uint16_t &r_baseline, const uint8_t *&r_body, uint32_t &r_body_length) {
+  SendStream **found = send_streams.getptr(key);
+  SendStream *stream = found == nullptr ? send_streams.insert(key, new SendStream) : *found;
+  stream->next_sequence = sequence + 1;
+  r_baseline = sequence;
+  r_body = payload;
+  r_body_length = length;
+  // the baseline is looked up before storing, sequence may share its slot
+  const MuxArray<uint8_t> *baseline = stream->has_acked && stream->since_keyframe < MUX_DELTA_KEYFRAME_INTERVAL ? stream->history.find(stream->acked) : nullptr;
+  scratch.resize(length);
+  uint32_t written;
+  bool encoded = baseline != nullptr && mux_delta_encode_runs(payload, length, baseline->ptr(), baseline->size(), scratch.ptr(), written);
+  MuxArray<uint8_t> &stored = stream->history.store(sequence);
+  stored.resize(length);
+  if (length != 0) {
+    memcpy(stored.ptr(), payload, length);
+  }
+  if (encoded) {
+    r_baseline = stream->acked;
+    r_body = scratch.ptr();
+    r_body_length = written;
+    stream->since_keyframe++;
+    return;
+  }
+  stream->since_keyframe = 0;
+}
+
+MuxError MuxDeltaCodec::decode(const MuxStreamKey &key, uint16_t sequence, uint16_t baseline, uint32_t decoded_length, const uint8_t *body, uint32_t length, const uint8_t *&r_payload, bool &r_acknowledge) {
+  ReceiveStream **found = receive_streams.getptr(key);
+  ReceiveStream *stream = found == nullptr ? receive_streams.insert(key, new ReceiveStream) : *found;
+  if (baseline == sequence) {
+    if (length != decoded_length) {
+      return MUX_ERR_PARSE;
+    }
+    MuxArray<uint8_t> &stored = stream->history.store(sequence);
+    stored.resize(length);
+    if (length != 0) {
+      memcpy(stored.ptr(), body, length);
+    }
+    r_payload = stored.ptr();
+    stream->since_ack = 0;
+    r_acknowledge = true;
+    return MUX_OK;
+  }
+  const MuxArray<uint8_t> *baseline_payload = stream->history.find(baseline);
+  if (baseline_payload == nullptr) {
+    // The baseline was never received or has been overwritten, drop until the next keyframe
+    return MUX_ERR_UNAVAILABLE;
+  }
+  // Decoded aside, the baseline may live in the slot the result goes to and a malformed body must not clobber it
+  scratch.resize(decoded_length);
+  if (!mux_delta_decode_runs(body, length, baseline_payload->ptr(), baseline_payload->size(), scratch.ptr(), decoded_length)) {
+    return MUX_ERR_PARSE;
+  }
+  MuxArray<uint8_t> &stored = stream->history.store(sequence);
+  stored.swap(scratch);
+  r_payload = stored.ptr();
+  stream->since_ack++;
+  r_acknowledge = stream->since_ack >= MUX_DELTA_ACK_INTERVAL;
+  if (r_acknowledge) {
+    stream->since_ack = 0;
+  }
+  return MUX_OK;
+}
+
+void MuxDeltaCodec::acknowledge(const MuxStreamKey &key, uint16_t sequence) {
+  SendStream **found = send_streams.getptr(key);
+  if (found == nullptr) {
+    return;
+  }
+  SendStream *stream = *found;
+  // Acks are unreliable and may arrive out of order, only ever move the baseline forward
+  if (stream->has_acked && !mux_sequence_is_newer(sequence, stream->acked)) {
+    return;
+  }
+  // An ack for a sequence that was never sent is ignored
+  if (!mux_sequence_is_newer(stream->next_sequence, sequence)) {
+    return;
+  }
+  stream->has_acked = true;
+  stream->acked = sequence;
+}
+
+template <class S>
+static void forget_streams(MuxTable<MuxStreamKey, S *, MuxStreamKeyHasher> &streams, int32_t subpeer) {
+  MuxArray<MuxStreamKey> to_erase;
+  for (uint32_t i = streams.next(0); i < streams.capacity(); i = streams.next(i + 1)) {
+    if (streams.key_at(i).source == subpeer || streams.key_at(i).dest == subpeer) {
+      to_erase.push_back(streams.key_at(i));
+    }
+  }
+  for (uint32_t i = 0; i < to_erase.size(); i++) {
+    delete *streams.getptr(to_erase[i]);
+    streams.erase(to_erase[i]);
+  }
+}
+
+template <class S>
+static void clear_streams(MuxTable<MuxStreamKey, S *, MuxStreamKeyHasher> &streams) {
+  for (uint32_t i = streams.next(0); i < streams.capacity(); i = streams.next(i + 1)) {
+    delete streams.value_at(i);
+  }
+  streams.clear();
+}
+
+void MuxDeltaCodec::forget(int32_t subpeer) {
+  forget_streams(send_streams, subpeer);
+  forget_streams(receive_streams, subpeer);
+}
+
+void MuxDeltaCodec::clear() {
+  clear_streams(send_streams);
+  clear_streams(receive_streams);
+}
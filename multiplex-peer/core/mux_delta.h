@@ -0,0 +1,59 @@
+#ifndef MUX_DELTA_H
+#define MUX_DELTA_H
+#include "mux_sequence.h"
+#include "mux_table.h"
+#include "mux_wire.h"
+#include <cstdint>
+
+// number of payloads remembered per stream, a baseline older than this can't be used
+#define MUX_DELTA_HISTORY 32
+// a keyframe is sent at least this often, so a receiver that lost its baselines recovers
+#define MUX_DELTA_KEYFRAME_INTERVAL 60
+// the receiver acknowledges every keyframe and every this many deltas
+#define MUX_DELTA_ACK_INTERVAL 4
+
+// MuxDeltaCodec encodes each unreliable payload of a stream against the newest payload the receiver
+// has acknowledged, see mux_delta_runs.h for the encoding. A payload is sent as a keyframe (the raw bytes,
+// baseline == sequence) when there is no usable baseline, every MUX_DELTA_KEYFRAME_INTERVAL packets,
+// or when the encoding would not be smaller.
+class MuxDeltaCodec {
+private:
+	struct History {
+		MuxArray<uint8_t> payloads[MUX_DELTA_HISTORY];
+		uint16_t sequences[MUX_DELTA_HISTORY];
+		bool valid[MUX_DELTA_HISTORY] = {};
+		MuxArray<uint8_t> &store(uint16_t sequence);
+		const MuxArray<uint8_t> *find(uint16_t sequence) const;
+	};
+	struct SendStream {
+		History history;
+		uint16_t next_sequence = 0; // one past the newest sequence encoded
+		bool has_acked = false;
+		uint16_t acked = 0;
+		uint16_t since_keyframe = 0;
+	};
+	struct ReceiveStream {
+		History history;
+		uint16_t since_ack = 0;
+	};
+	// streams hold their whole history, so the tables only hold pointers to them
+	MuxTable<MuxStreamKey, SendStream *, MuxStreamKeyHasher> send_streams;
+	MuxTable<MuxStreamKey, ReceiveStream *, MuxStreamKeyHasher> receive_streams;
+	MuxArray<uint8_t> scratch;
+	MuxDeltaCodec(const MuxDeltaCodec &);
+	MuxDeltaCodec &operator=(const MuxDeltaCodec &);
+public:
+	MuxDeltaCodec() {}
+	~MuxDeltaCodec();
+	// sequence comes from the stream's MuxSequencer, r_baseline == sequence for a keyframe.
+	// r_body is payload itself for a keyframe, otherwise it is only valid until the next encode.
+	void encode(const MuxStreamKey &key, const uint8_t *payload, uint32_t length, uint16_t sequence, uint16_t &r_baseline, const uint8_t *&r_body, uint32_t &r_body_length);
+	// r_payload holds decoded_length bytes and is valid until the stream is decoded again or forgotten.
+	// r_acknowledge is set when the receiver should send MUX_CMD_DELTA_ACK for this sequence.
+	// MUX_ERR_UNAVAILABLE when the baseline was lost, the stream recovers with the next keyframe.
+	MuxError decode(const MuxStreamKey &key, uint16_t sequence, uint16_t baseline, uint32_t decoded_length, const uint8_t *body, uint32_t length, const uint8_t *&r_payload, bool &r_acknowledge);
+	void acknowledge(const MuxStreamKey &key, uint16_t sequence);
+	void forget(int32_t subpeer); // drops every stream to or from subpeer
+	void clear();
+};
+#endif
@@ -0,0 +1,77 @@
+#include "mux_delta_runs.h"
+
+static uint32_t write_varint(uint8_t *out, uint32_t value) {
+  uint32_t written = 0;
+  while (value >= 0x80) {
+    out[written++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[written++] = (uint8_t)value;
+  return written;
+}
+
+static bool read_varint(const uint8_t *in, uint32_t length, uint32_t &r_pos, uint32_t &r_value) {
+  r_value = 0;
+  for (uint32_t shift = 0; shift < 35; shift += 7) {
+    if (r_pos >= length) {
+      return false;
+    }
+    uint8_t byte = in[r_pos++];
+    r_value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool mux_delta_encode_runs(const uint8_t *payload, uint32_t length, const uint8_t *baseline, uint32_t baseline_length, uint8_t *out, uint32_t &r_written) {
+  // Gives up as soon as the encoding is no smaller than the payload, a keyframe is sent instead
+  uint32_t written = 0;
+  uint32_t pos = 0;
+  while (pos < length) {
+    uint32_t zeros = 0;
+    while (pos + zeros < length && payload[pos + zeros] == (pos + zeros < baseline_length ? baseline[pos + zeros] : 0)) {
+      zeros++;
+    }
+    uint32_t literals_start = pos + zeros;
+    uint32_t literals = 0;
+    while (literals_start + literals < length && payload[literals_start + literals] != (literals_start + literals < baseline_length ? baseline[literals_start + literals] : 0)) {
+      literals++;
+    }
+    // two varints take at most 10 bytes
+    if (written + 10 + literals >= length) {
+      return false;
+    }
+    written += write_varint(out + written, zeros);
+    written += write_varint(out + written, literals);
+    for (uint32_t i = literals_start; i < literals_start + literals; i++) {
+      out[written++] = payload[i] ^ (i < baseline_length ? baseline[i] : 0);
+    }
+    pos = literals_start + literals;
+  }
+  r_written = written;
+  return true;
+}
+
+bool mux_delta_decode_runs(const uint8_t *encoded, uint32_t length, const uint8_t *baseline, uint32_t baseline_length, uint8_t *r_payload, uint32_t decoded_length) {
+  uint32_t in = 0;
+  uint32_t pos = 0;
+  while (pos < decoded_length) {
+    uint32_t zeros;
+    uint32_t literals;
+    if (!read_varint(encoded, length, in, zeros) || !read_varint(encoded, length, in, literals)) {
+      return false;
+    }
+    if (zeros > decoded_length - pos || literals > decoded_length - pos - zeros || literals > length - in) {
+      return false;
+    }
+    for (uint32_t end = pos + zeros; pos < end; pos++) {
+      r_payload[pos] = pos < baseline_length ? baseline[pos] : 0;
+    }
+    for (uint32_t end = pos + literals; pos < end; pos++) {
+      r_payload[pos] = encoded[in++] ^ (pos < baseline_length ? baseline[pos] : 0);
+    }
+  }
+  return in == length;
+}
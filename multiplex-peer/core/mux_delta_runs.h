@@ -0,0 +1,14 @@
+#ifndef MUX_DELTA_RUNS_H
+#define MUX_DELTA_RUNS_H
+#include <cstdint>
+
+// The byte level half of delta encoding, the stream bookkeeping lives in MuxDeltaCodec.
+// A payload is XOR'd with its baseline and the result is stored as runs:
+//   varint zeros, varint literal_count, uint8_t[literal_count] literals, repeated until decoded_length is reached
+// Bytes past the end of the baseline are XOR'd with 0.
+
+// out must hold length bytes. Returns false as soon as the encoding would not be smaller than the payload.
+bool mux_delta_encode_runs(const uint8_t *payload, uint32_t length, const uint8_t *baseline, uint32_t baseline_length, uint8_t *out, uint32_t &r_written);
+// r_payload must hold decoded_length bytes. Returns false if encoded is malformed.
+bool mux_delta_decode_runs(const uint8_t *encoded, uint32_t length, const uint8_t *baseline, uint32_t baseline_length, uint8_t *r_payload, uint32_t decoded_length);
+#endif
@@ -0,0 +1,194 @@
+#include "mux_demux.h"
+
+void MuxDemux::set_transport(MuxTransport *transport) {
+  this->transport = transport;
+}
+
+MuxTransport *MuxDemux::get_transport() const {
+  return transport;
+}
+
+bool MuxDemux::add_session(uint16_t session_id, MuxSession *session) {
+  if (sessions.has(session_id)) {
+    return false;
+  }
+  sessions.insert(session_id, session);
+  session->set_session_id(session_id);
+  session->attach(transport);
+  return true;
+}
+
+void MuxDemux::remove_session(uint16_t session_id) {
+  MuxSession **session = sessions.getptr(session_id);
+  if (session == nullptr) {
+    return;
+  }
+  (*session)->attach(nullptr);
+  sessions.erase(session_id);
+}
+
+MuxSession *MuxDemux::get_session(uint16_t session_id) const {
+  MuxSession *const *session = sessions.getptr(session_id);
+  return session == nullptr ? nullptr : *session;
+}
+
+uint32_t MuxDemux::get_session_count() const {
+  return sessions.size();
+}
+
+void MuxDemux::set_max_packets_per_tick(uint32_t max_packets) {
+  max_packets_per_tick = max_packets;
+}
+
+uint32_t MuxDemux::get_max_packets_per_tick() const {
+  return max_packets_per_tick;
+}
+
+void MuxDemux::set_max_bytes_per_tick(uint32_t max_bytes) {
+  max_bytes_per_tick = max_bytes;
+}
+
+uint32_t MuxDemux::get_max_bytes_per_tick() const {
+  return max_bytes_per_tick;
+}
+
+void MuxDemux::set_violation_limit(uint32_t limit) {
+  violation_limit = limit;
+}
+
+uint32_t MuxDemux::get_violation_limit() const {
+  return violation_limit;
+}
+
+bool MuxDemux::is_violation(MuxError error) {
+  // Only malformed, spoofed and over budget packets count against the sender, data from an unknown subpeer is
+  // taken as spoofed. Packets for subpeers that have just left are expected.
+  return error == MUX_ERR_PARSE || error == MUX_ERR_UNKNOWN_SOURCE || error == MUX_ERR_UNAUTHORIZED || error == MUX_ERR_INVALID || error == MUX_ERR_BUSY;
+}
+
+bool MuxDemux::is_failed_command(MuxError error) {
+  return error == MUX_ERR_REFUSED;
+}
+
+void MuxDemux::host_peer_connected(int32_t host_peer) {
+  // A session may end, and leave the demux, in reaction to the event, so sessions are looked up one at a time
+  MuxArray<uint16_t> session_ids;
+  for (uint32_t i = sessions.next(0); i < sessions.capacity(); i = sessions.next(i + 1)) {
+    session_ids.push_back(sessions.key_at(i));
+  }
+  for (uint32_t i = 0; i < session_ids.size(); i++) {
+    MuxSession *session = get_session(session_ids[i]);
+    if (session != nullptr) {
+      session->host_peer_connected(host_peer);
+    }
+  }
+}
+
+void MuxDemux::host_peer_disconnected(int32_t host_peer) {
+  ingress.erase(host_peer);
+  host_peer_sessions.erase(host_peer);
+  MuxArray<uint16_t> session_ids;
+  for (uint32_t i = sessions.next(0); i < sessions.capacity(); i = sessions.next(i + 1)) {
+    session_ids.push_back(sessions.key_at(i));
+  }
+  for (uint32_t i = 0; i < session_ids.size(); i++) {
+    MuxSession *session = get_session(session_ids[i]);
+    if (session != nullptr) {
+      session->host_peer_disconnected(host_peer);
+    }
+  }
+}
+
+MuxError MuxDemux::receive(int32_t sender, int32_t channel, const uint8_t *data, uint32_t size, uint64_t tick) {
+  // Everything up to the session lookup only reads the header, so junk is cheap to drop
+  bool first_over_budget;
+  if (!admit(sender, size, tick, first_over_budget)) {
+    if (!first_over_budget) {
+      return MUX_OK;
+    }
+    // the rest of this tick's packets are dropped, but only count as one violation
+    count(sender, MUX_ERR_BUSY);
+    return MUX_ERR_BUSY;
+  }
+  MuxError error = mux_validate(data, size);
+  uint16_t session_id = 0;
+  if (error == MUX_OK) {
+    error = mux_peek_session(data, size, session_id);
+  }
+  if (error != MUX_OK) {
+    count(sender, error);
+    return error;
+  }
+  MuxSession *session = get_session(session_id);
+  if (session == nullptr) {
+    return MUX_ERR_UNAVAILABLE;
+  }
+  if (transport != nullptr && transport->is_server() && !admit_session(sender, session_id)) {
+    count(sender, MUX_ERR_UNAUTHORIZED);
+    return MUX_ERR_UNAUTHORIZED;
+  }
+  error = session->receive(sender, channel, data, size);
+  count(sender, error);
+  return error;
+}
+
+bool MuxDemux::admit(int32_t host_peer, uint32_t size, uint64_t tick, bool &r_first_over_budget) {
+  r_first_over_budget = false;
+  if (max_packets_per_tick == 0 && max_bytes_per_tick == 0) {
+    return true;
+  }
+  IngressStats *stats = ingress.getptr(host_peer);
+  if (stats == nullptr) {
+    stats = &ingress.insert(host_peer, IngressStats());
+  }
+  if (stats->tick != tick) {
+    stats->tick = tick;
+    stats->packets = 0;
+    stats->bytes = 0;
+    stats->over_budget = false;
+  }
+  stats->packets++;
+  stats->bytes += size;
+  if ((max_packets_per_tick != 0 && stats->packets > max_packets_per_tick) || (max_bytes_per_tick != 0 && stats->bytes > max_bytes_per_tick)) {
+    r_first_over_budget = !stats->over_budget;
+    stats->over_budget = true;
+    return false;
+  }
+  return true;
+}
+
+bool MuxDemux::admit_session(int32_t host_peer, uint16_t session) {
+  // A session id is only a number in the header, so a host peer that could pick any session could join every match
+  const uint16_t *pinned = host_peer_sessions.getptr(host_peer);
+  if (pinned != nullptr) {
+    return *pinned == session;
+  }
+  if (!listener.admit_session(host_peer, session)) {
+    return false;
+  }
+  host_peer_sessions.insert(host_peer, session);
+  return true;
+}
+
+void MuxDemux::count(int32_t host_peer, MuxError error) {
+  // Only the server disconnects anyone
+  bool violation = is_violation(error);
+  bool failed_command = is_failed_command(error);
+  if ((!violation && !failed_command) || violation_limit == 0 || transport == nullptr || !transport->is_server() || host_peer == transport->get_unique_id()) {
+    return;
+  }
+  IngressStats *stats = ingress.getptr(host_peer);
+  if (stats == nullptr) {
+    stats = &ingress.insert(host_peer, IngressStats());
+  }
+  // each failed command is answered reliably, so only a host peer that keeps sending them is counted
+  if (failed_command && ++stats->failed_commands % MUX_FAILED_COMMANDS_PER_VIOLATION != 0) {
+    return;
+  }
+  stats->violations++;
+  if (stats->violations >= violation_limit) {
+    uint32_t violations = stats->violations;
+    ingress.erase(host_peer);
+    listener.disconnect_host_peer(host_peer, violations);
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef MUX_DEMUX_H
+#define MUX_DEMUX_H
+#include "mux_session.h"
+#include "mux_table.h"
+#include "mux_transport.h"
+#include "mux_wire.h"
+#include <cstdint>
+
+// a host peer whose commands keep failing is counted one violation per this many of them
+#define MUX_FAILED_COMMANDS_PER_VIOLATION 4
+
+// What a MuxDemux asks of the code embedding it, in Godot this is MultiplexDemux
+class MuxDemuxListener {
+public:
+	virtual ~MuxDemuxListener() {}
+	// server: asked once per host peer, on its first packet, before it is pinned to session
+	virtual bool admit_session(int32_t host_peer, uint16_t session) = 0;
+	// server: host_peer reached the violation limit and should be disconnected, the demux has forgotten its counts
+	virtual void disconnect_host_peer(int32_t host_peer, uint32_t violations) = 0;
+};
+
+// MuxDemux hands every packet from one transport to the MuxSession registered for its session id, after
+// checking the sender's ingress budget, the packet's format and, on a server, which session the sender may use.
+// It counts malformed, spoofed and over budget packets against their host peer. The sessions stay owned by
+// the caller.
+class MuxDemux {
+private:
+	// What one remote host peer has sent this tick, and how often it has misbehaved since it connected
+	struct IngressStats {
+		uint64_t tick = 0;
+		uint32_t packets = 0;
+		uint32_t bytes = 0;
+		uint32_t violations = 0;
+		uint32_t failed_commands = 0;
+		bool over_budget = false;
+	};
+	MuxDemuxListener &listener;
+	MuxTransport *transport = nullptr;
+	MuxTable<uint16_t, MuxSession *> sessions;
+	MuxTable<int32_t, IngressStats> ingress;
+	// server: each remote host peer is pinned to the first session it was admitted to
+	MuxTable<int32_t, uint16_t> host_peer_sessions;
+	uint32_t max_packets_per_tick = 0; // 0 = inf
+	uint32_t max_bytes_per_tick = 0; // 0 = inf
+	uint32_t violation_limit = 0; // 0 = never disconnect
+	MuxDemux(const MuxDemux &);
+	MuxDemux &operator=(const MuxDemux &);
+	bool admit(int32_t host_peer, uint32_t size, uint64_t tick, bool &r_first_over_budget);
+	bool admit_session(int32_t host_peer, uint16_t session);
+	void count(int32_t host_peer, MuxError error);
+
+public:
+	MuxDemux(MuxDemuxListener &listener) : listener(listener) {}
+	// Sessions added later are attached to transport, the ones already added are not touched
+	void set_transport(MuxTransport *transport);
+	MuxTransport *get_transport() const;
+	// false if session_id is taken. The session is attached to the transport, its subpeers are kept.
+	bool add_session(uint16_t session_id, MuxSession *session);
+	// the session is taken offline
+	void remove_session(uint16_t session_id);
+	MuxSession *get_session(uint16_t session_id) const;
+	uint32_t get_session_count() const;
+	void set_max_packets_per_tick(uint32_t max_packets);
+	uint32_t get_max_packets_per_tick() const;
+	void set_max_bytes_per_tick(uint32_t max_bytes);
+	uint32_t get_max_bytes_per_tick() const;
+	void set_violation_limit(uint32_t limit);
+	uint32_t get_violation_limit() const;
+	static bool is_violation(MuxError error);
+	// an id collision or a full session happens to an honest client now and then, a stream of them does not
+	static bool is_failed_command(MuxError error);
+
+	void host_peer_connected(int32_t host_peer);
+	void host_peer_disconnected(int32_t host_peer);
+	// Budgets are per tick, whatever the caller polls by, in Godot that is a process frame.
+	// Returns why the packet was dropped, packets over budget after the first of a tick are dropped with MUX_OK.
+	MuxError receive(int32_t sender, int32_t channel, const uint8_t *data, uint32_t size, uint64_t tick);
+};
+#endif
@@ -0,0 +1,39 @@
+#include "mux_router.h"
+
+MuxError mux_route_data(const uint8_t *data, uint32_t size, int32_t sender_host_peer, bool forwarding, const MuxDirectory &directory, MuxRoute &r_route) {
+  uint8_t transfer_mode;
+  MuxError error = mux_peek_data_header(data, size, transfer_mode, r_route.source, r_route.dest);
+  if (error != MUX_OK) {
+    return error;
+  }
+  r_route.transfer_mode = (MuxTransferMode)transfer_mode;
+  int32_t source_owner;
+  if (!directory.get_subpeer_owner(r_route.source, source_owner)) {
+    return MUX_ERR_UNKNOWN_SOURCE;
+  }
+  if (source_owner != sender_host_peer) {
+    // Possible attempt at cheating
+    return MUX_ERR_UNAUTHORIZED;
+  }
+  if (data[0] == MUX_DATA_DELTA && r_route.dest <= 0) {
+    // Delta streams are always between two subpeers
+    return MUX_ERR_PARSE;
+  }
+  if (r_route.dest <= 0) {
+    r_route.action = forwarding ? MUX_ROUTE_FORWARD_AND_DELIVER : MUX_ROUTE_DELIVER;
+    return MUX_OK;
+  }
+  if (directory.has_local_subpeer(r_route.dest)) {
+    r_route.action = MUX_ROUTE_DELIVER;
+    return MUX_OK;
+  }
+  // Packets between subpeers of two other host peers are passed on without being unpacked
+  if (!forwarding || !directory.get_subpeer_owner(r_route.dest, r_route.host_peer)) {
+    return MUX_ERR_UNKNOWN_SUBPEER;
+  }
+  if (r_route.host_peer == sender_host_peer) {
+    return MUX_ERR_INVALID;
+  }
+  r_route.action = r_route.host_peer == MUX_HOST_PEER_AWAY ? MUX_ROUTE_DROP : MUX_ROUTE_FORWARD;
+  return MUX_OK;
+}
@@ -0,0 +1,42 @@
+#ifndef MUX_ROUTER_H
+#define MUX_ROUTER_H
+#include "mux_wire.h"
+#include <cstdint>
+
+// owner of a subpeer whose host peer dropped and may still resume, packets to it are dropped
+#define MUX_HOST_PEER_AWAY 0
+
+// Which subpeers a network knows about, looked up for every data packet it receives
+class MuxDirectory {
+public:
+	virtual ~MuxDirectory() {}
+	virtual bool has_local_subpeer(int32_t subpeer) const = 0;
+	// false if subpeer is not a known remote subpeer
+	virtual bool get_subpeer_owner(int32_t subpeer, int32_t &r_host_peer) const = 0;
+};
+
+enum MuxRouteAction {
+	MUX_ROUTE_DELIVER, // unpack and deliver to local subpeers
+	MUX_ROUTE_FORWARD, // pass the packet unchanged to host_peer
+	MUX_ROUTE_FORWARD_AND_DELIVER, // a broadcast, pass it unchanged to every other host peer and deliver it locally
+	MUX_ROUTE_DROP // addressed to a subpeer whose host peer is away, lost as if it were lost in transit
+};
+
+struct MuxRoute {
+	MuxRouteAction action;
+	MuxTransferMode transfer_mode;
+	int32_t source;
+	int32_t dest;
+	int32_t host_peer; // MUX_ROUTE_FORWARD only
+};
+
+// The subpeer a broadcast to dest <= 0 leaves out. dest comes off the wire, so it is negated as unsigned and
+// INT32_MIN, which is no subpeer, stays as it is instead of overflowing.
+static inline int32_t mux_broadcast_excluded(int32_t dest) {
+	return (int32_t)(0u - (uint32_t)dest);
+}
+
+// Decides what happens to a validated data or delta packet from sender_host_peer by reading only its header.
+// forwarding is true on a server that forwards packets between subpeers of different host peers.
+MuxError mux_route_data(const uint8_t *data, uint32_t size, int32_t sender_host_peer, bool forwarding, const MuxDirectory &directory, MuxRoute &r_route);
+#endif
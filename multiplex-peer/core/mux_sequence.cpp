@@ -0,0 +1,63 @@
+#include "mux_sequence.h"
+
+// drops every stream of table to or from subpeer
+template <class V>
+static void forget_streams(MuxTable<MuxStreamKey, V, MuxStreamKeyHasher> &table, int32_t subpeer) {
+  MuxArray<MuxStreamKey> to_erase;
+  for (uint32_t i = table.next(0); i < table.capacity(); i = table.next(i + 1)) {
+    if (table.key_at(i).source == subpeer || table.key_at(i).dest == subpeer) {
+      to_erase.push_back(table.key_at(i));
+    }
+  }
+  for (uint32_t i = 0; i < to_erase.size(); i++) {
+    table.erase(to_erase[i]);
+  }
+}
+
+uint16_t MuxSequencer::next(const MuxStreamKey &key) {
+  uint16_t *next = next_sequences.getptr(key);
+  if (next == nullptr) {
+    next = &next_sequences.insert(key, 0);
+  }
+  return (*next)++;
+}
+
+uint16_t *MuxSequencer::get_newest(const MuxStreamKey &key) {
+  return newest_received.getptr(key);
+}
+
+void MuxSequencer::insert_newest(const MuxStreamKey &key, uint16_t sequence) {
+  newest_received.insert(key, sequence);
+}
+
+void MuxSequencer::forget(int32_t subpeer) {
+  forget_streams(next_sequences, subpeer);
+  forget_streams(newest_received, subpeer);
+}
+
+void MuxSequencer::clear() {
+  next_sequences.clear();
+  newest_received.clear();
+}
+
+bool mux_sequence_accept(MuxSequenceHistory &history, const MuxStreamKey &key, uint16_t sequence) {
+  uint16_t *newest = history.get_newest(key);
+  if (newest == nullptr) {
+    history.insert_newest(key, sequence);
+    return true;
+  }
+  if (!mux_sequence_is_newer(sequence, *newest)) {
+    return false;
+  }
+  *newest = sequence;
+  return true;
+}
+
+bool mux_accept_delivery(MuxSequenceHistory &history, const uint8_t *data, uint32_t size, const MuxRoute &route, int32_t channel) {
+  uint16_t sequence;
+  if (route.transfer_mode != MUX_TRANSFER_MODE_UNRELIABLE_ORDERED || mux_peek_sequence(data, size, sequence) != MUX_OK) {
+    return true;
+  }
+  MuxStreamKey key = { route.source, route.dest, channel };
+  return mux_sequence_accept(history, key, sequence);
+}
@@ -0,0 +1,53 @@
+#ifndef MUX_SEQUENCE_H
+#define MUX_SEQUENCE_H
+#include "mux_router.h"
+#include "mux_table.h"
+#include "mux_wire.h"
+#include <cstdint>
+
+// Packets from one subpeer to another on one channel
+struct MuxStreamKey {
+	int32_t source;
+	int32_t dest;
+	int32_t channel;
+	bool operator==(const MuxStreamKey &other) const {
+		return source == other.source && dest == other.dest && channel == other.channel;
+	}
+};
+
+struct MuxStreamKeyHasher {
+	static uint32_t hash(const MuxStreamKey &key) {
+		return mux_hash_u32((uint32_t)key.source ^ mux_hash_u32((uint32_t)key.dest ^ mux_hash_u32((uint32_t)key.channel)));
+	}
+};
+
+// Where a network keeps the newest sequence received on each stream
+class MuxSequenceHistory {
+public:
+	virtual ~MuxSequenceHistory() {}
+	// nullptr if nothing was received on the stream yet
+	virtual uint16_t *get_newest(const MuxStreamKey &key) = 0;
+	virtual void insert_newest(const MuxStreamKey &key, uint16_t sequence) = 0;
+};
+
+// MuxSequencer numbers the packets of each stream sent to a remote subpeer, and remembers the newest
+// sequence received per stream so unreliable ordered packets that arrive after a newer one can be dropped.
+// Delta encoded packets are numbered from the same counter, so both kinds can be mixed on one stream.
+class MuxSequencer : public MuxSequenceHistory {
+private:
+	MuxTable<MuxStreamKey, uint16_t, MuxStreamKeyHasher> next_sequences;
+	MuxTable<MuxStreamKey, uint16_t, MuxStreamKeyHasher> newest_received;
+public:
+	uint16_t next(const MuxStreamKey &key);
+	uint16_t *get_newest(const MuxStreamKey &key) override;
+	void insert_newest(const MuxStreamKey &key, uint16_t sequence) override;
+	void forget(int32_t subpeer); // drops every stream to or from subpeer
+	void clear();
+};
+
+// false if a newer packet of the stream was already accepted, the packet is then stale
+bool mux_sequence_accept(MuxSequenceHistory &history, const MuxStreamKey &key, uint16_t sequence);
+// false if a packet routed for delivery is unreliable ordered and older than one already delivered on its stream.
+// Only reads the header, any other packet is accepted without touching history.
+bool mux_accept_delivery(MuxSequenceHistory &history, const uint8_t *data, uint32_t size, const MuxRoute &route, int32_t channel);
+#endif
@@ -0,0 +1,887 @@
+#include "mux_session.h"
+
+// Listener callbacks may add or close subpeers, so anything that calls them while walking a table walks a
+// copy of its keys instead.
+
+void MuxSession::set_session_id(uint16_t session_id) {
+  this->session_id = session_id;
+}
+
+uint16_t MuxSession::get_session_id() const {
+  return session_id;
+}
+
+void MuxSession::set_max_subpeers(uint32_t max_subpeers) {
+  this->max_subpeers = max_subpeers;
+}
+
+uint32_t MuxSession::get_max_subpeers() const {
+  return max_subpeers;
+}
+
+void MuxSession::set_header_forwarding(bool enabled) {
+  header_forwarding = enabled;
+}
+
+bool MuxSession::is_header_forwarding() const {
+  return header_forwarding;
+}
+
+void MuxSession::set_delta_encoding(bool enabled) {
+  delta_encoding = enabled;
+}
+
+bool MuxSession::is_delta_encoding() const {
+  return delta_encoding;
+}
+
+void MuxSession::set_resume_grace_period_msec(uint32_t grace_period_msec) {
+  resume_grace_period_msec = grace_period_msec;
+}
+
+uint32_t MuxSession::get_resume_grace_period_msec() const {
+  return resume_grace_period_msec;
+}
+
+void MuxSession::attach(MuxTransport *transport) {
+  this->transport = transport;
+}
+
+void MuxSession::reset() {
+  local_subpeers.clear();
+  remote_subpeers.clear();
+  sequencer.clear();
+  delta.clear();
+  resume_tokens.clear();
+  suspended_hosts.clear();
+  resume_token = 0;
+  resuming = false;
+  closed_while_resuming.clear();
+  pending_add_peers.clear();
+  removed_subpeers.clear();
+}
+
+bool MuxSession::is_offline() const {
+  return transport == nullptr;
+}
+
+bool MuxSession::is_server() const {
+  // Offline the session is its own server
+  return transport == nullptr || transport->is_server();
+}
+
+int32_t MuxSession::get_local_host_peer_id() const {
+  return transport == nullptr ? 1 : transport->get_unique_id();
+}
+
+bool MuxSession::is_resuming() const {
+  return resuming;
+}
+
+bool MuxSession::has_local_subpeer(int32_t subpeer) const {
+  return local_subpeers.has(subpeer);
+}
+
+bool MuxSession::get_subpeer_owner(int32_t subpeer, int32_t &r_host_peer) const {
+  const int32_t *owner = remote_subpeers.getptr(subpeer);
+  if (owner == nullptr) {
+    return false;
+  }
+  r_host_peer = *owner;
+  return true;
+}
+
+bool MuxSession::has_subpeer(int32_t subpeer) const {
+  return local_subpeers.has(subpeer) || remote_subpeers.has(subpeer);
+}
+
+bool MuxSession::is_remote_subpeer(int32_t subpeer) const {
+  return remote_subpeers.has(subpeer);
+}
+
+int32_t MuxSession::get_subpeer_host_peer(int32_t subpeer) const {
+  if (local_subpeers.has(subpeer)) {
+    return get_local_host_peer_id();
+  }
+  const int32_t *owner = remote_subpeers.getptr(subpeer);
+  return owner == nullptr ? -1 : *owner;
+}
+
+bool MuxSession::connects_locally() const {
+  return transport == nullptr ? local_subpeers.has(1) : transport->is_server();
+}
+
+MuxError MuxSession::add_local_subpeer(int32_t subpeer) {
+  if (local_subpeers.has(subpeer)) {
+    return MUX_ERR_INVALID;
+  }
+  local_subpeers.insert(subpeer, subpeer == 1);
+  if (subpeer != 1 && transport != nullptr && !transport->is_server() && transport->is_connected()) {
+    // A late subpeer, the rest were asked for when the server connected
+    request_add_peer(subpeer);
+  }
+  return MUX_OK;
+}
+
+void MuxSession::connect_local_subpeer(int32_t subpeer) {
+  bool *connected = local_subpeers.getptr(subpeer);
+  if (connected == nullptr || *connected) {
+    return;
+  }
+  *connected = true;
+  listener.local_subpeer_connected(subpeer);
+  if (subpeer == 1) {
+    return;
+  }
+  listener.subpeer_connected(subpeer, 1);
+  if (local_subpeers.has(1)) {
+    listener.subpeer_connected(1, subpeer);
+  }
+  if (header_forwarding && local_subpeers.has(subpeer)) {
+    introduce_local_subpeer(subpeer);
+  }
+}
+
+void MuxSession::close_local_subpeer(int32_t subpeer) {
+  if (!local_subpeers.has(subpeer)) {
+    return;
+  }
+  if (subpeer == 1) {
+    end_session();
+    return;
+  }
+  local_subpeers.erase(subpeer);
+  pending_add_peers.erase(subpeer);
+  delta.forget(subpeer);
+  sequencer.forget(subpeer);
+  listener.subpeer_disconnected(subpeer, 1);
+  if (is_server()) {
+    if (local_subpeers.has(1)) {
+      listener.subpeer_disconnected(1, subpeer);
+    }
+    if (header_forwarding) {
+      notify_local_subpeers(false, subpeer);
+      announce_subpeer(MUX_CMD_REMOVE_PEER, subpeer, get_local_host_peer_id());
+    }
+    return;
+  }
+  if (resuming) {
+    // the server is away, it is told once the session has resumed
+    closed_while_resuming.push_back(subpeer);
+  }
+  else {
+    send_command(MUX_CMD_REMOVE_PEER, subpeer, 1);
+  }
+  if (header_forwarding) {
+    notify_local_subpeers(false, subpeer);
+  }
+}
+
+void MuxSession::end_session() {
+  // Subpeer 1 has closed. Every other subpeer goes with it, and every host peer with subpeers here is told the
+  // server left, so a transport shared with other sessions can stay open.
+  MuxArray<int32_t> locals;
+  collect_local_subpeers(locals, 1, false);
+  MuxArray<int32_t> remotes;
+  fan_out_targets.clear();
+  fan_out_seen.clear();
+  fan_out_seen.insert(MUX_HOST_PEER_AWAY, true);
+  fan_out_seen.insert(get_local_host_peer_id(), true);
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    remotes.push_back(remote_subpeers.key_at(i));
+    int32_t owner = remote_subpeers.value_at(i);
+    if (!fan_out_seen.has(owner)) {
+      fan_out_seen.insert(owner, true);
+      fan_out_targets.push_back(owner);
+    }
+  }
+  reset();
+  for (uint32_t i = 0; i < fan_out_targets.size(); i++) {
+    send_command(MUX_CMD_REMOVE_PEER, 1, fan_out_targets[i]);
+  }
+  for (uint32_t i = 0; i < remotes.size(); i++) {
+    listener.subpeer_disconnected(1, remotes[i]);
+  }
+  for (uint32_t i = 0; i < locals.size(); i++) {
+    listener.subpeer_disconnected(1, locals[i]);
+    listener.subpeer_disconnected(locals[i], 1);
+    listener.local_subpeer_closed(locals[i]);
+  }
+}
+
+void MuxSession::kick_subpeer(int32_t subpeer) {
+  const int32_t *found = remote_subpeers.getptr(subpeer);
+  if (found == nullptr || subpeer == 1 || !is_server()) {
+    return;
+  }
+  int32_t owner = *found;
+  if (owner != MUX_HOST_PEER_AWAY) {
+    send_command(MUX_CMD_REMOVE_PEER, subpeer, owner);
+  }
+  forget_remote_subpeer(subpeer, owner);
+}
+
+void MuxSession::host_peer_connected(int32_t host_peer) {
+  if (host_peer != 1 || is_server()) {
+    // Clients initiate adding their subpeers
+    return;
+  }
+  remote_subpeers.insert(1, 1);
+  if (resuming) {
+    // One command reclaims every subpeer, subpeers created while we were away are added once it is acknowledged
+    send_resume_command(MUX_CMD_RESUME, resume_token, 1);
+    return;
+  }
+  MuxArray<int32_t> subpeers;
+  collect_local_subpeers(subpeers, 1, false);
+  for (uint32_t i = 0; i < subpeers.size(); i++) {
+    request_add_peer(subpeers[i]);
+  }
+}
+
+void MuxSession::host_peer_disconnected(int32_t host_peer) {
+  if (host_peer == 1 && !is_server()) {
+    // Whatever was in flight may or may not have arrived
+    pending_add_peers.clear();
+    if (resume_grace_period_msec != 0 && resume_token != 0) {
+      // Subpeers stay connected and their packets are dropped until the server is back or the grace period ends
+      resuming = true;
+      resume_expires_msec = listener.get_ticks_msec() + resume_grace_period_msec;
+      return;
+    }
+    close_all_subpeers();
+  }
+  else if (resume_grace_period_msec != 0 && resume_tokens.has(host_peer)) {
+    suspend_host_peer(host_peer);
+  }
+  else {
+    remove_subpeers_of(host_peer);
+  }
+}
+
+void MuxSession::update() {
+  if (!resuming && suspended_hosts.is_empty()) {
+    return;
+  }
+  uint64_t now = listener.get_ticks_msec();
+  if (resuming && now >= resume_expires_msec) {
+    // the server did not come back in time
+    close_all_subpeers();
+  }
+  MuxArray<uint64_t> expired;
+  for (uint32_t i = suspended_hosts.next(0); i < suspended_hosts.capacity(); i = suspended_hosts.next(i + 1)) {
+    if (now >= suspended_hosts.value_at(i).expires_msec) {
+      expired.push_back(suspended_hosts.key_at(i));
+    }
+  }
+  for (uint32_t i = 0; i < expired.size(); i++) {
+    SuspendedHost *suspended = suspended_hosts.getptr(expired[i]);
+    if (suspended == nullptr) {
+      continue;
+    }
+    MuxArray<int32_t> subpeers = suspended->subpeers;
+    suspended_hosts.erase(expired[i]);
+    for (uint32_t j = 0; j < subpeers.size(); j++) {
+      // subpeer 1 may have kicked it in the meantime
+      const int32_t *owner = remote_subpeers.getptr(subpeers[j]);
+      if (owner != nullptr && *owner == MUX_HOST_PEER_AWAY) {
+        remove_remote_subpeer(subpeers[j], MUX_HOST_PEER_AWAY);
+      }
+    }
+  }
+}
+
+MuxError MuxSession::send(int32_t source, int32_t dest, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *payload, uint32_t length) {
+  uint8_t header[MULTIPLEX_DELTA_HEADER_SIZE];
+  MultiplexPacketData data = {};
+  data.length = length;
+  data.mux_peer_source = source;
+  data.mux_peer_dest = dest;
+  MuxStreamKey key = { source, dest, channel };
+  if (dest <= 0) {
+    listener.deliver(source, dest, channel, transfer_mode, payload, length);
+    if (transport == nullptr) {
+      return MUX_OK;
+    }
+    // Remote host peers share one header, the transport puts it in front of the payload once
+    uint8_t subtype = MUX_DATA;
+    if (transfer_mode == MUX_TRANSFER_MODE_UNRELIABLE_ORDERED) {
+      subtype = MUX_DATA_SEQUENCED;
+      data.sequence = sequencer.next(key);
+    }
+    uint32_t header_size = mux_write_data_header(header, subtype, transfer_mode, session_id, data);
+    return put_to_host_peers(header, header_size, payload, length, transport->get_unique_id(), mux_broadcast_excluded(dest), channel, transfer_mode);
+  }
+  if (local_subpeers.has(dest)) {
+    listener.deliver(source, dest, channel, transfer_mode, payload, length);
+    return MUX_OK;
+  }
+  const int32_t *owner = remote_subpeers.getptr(dest);
+  if (owner == nullptr || transport == nullptr) {
+    return MUX_ERR_UNKNOWN_SUBPEER;
+  }
+  if (resuming || *owner == MUX_HOST_PEER_AWAY) {
+    // The host peer is away, the packet is lost as if it were lost in transit
+    return MUX_OK;
+  }
+  uint8_t subtype = MUX_DATA;
+  const uint8_t *body = payload;
+  if (delta_encoding && transfer_mode != MUX_TRANSFER_MODE_RELIABLE) {
+    subtype = MUX_DATA_DELTA;
+    data.sequence = sequencer.next(key);
+    data.decoded_length = length;
+    delta.encode(key, payload, length, data.sequence, data.baseline, body, data.length);
+  }
+  else if (transfer_mode == MUX_TRANSFER_MODE_UNRELIABLE_ORDERED) {
+    subtype = MUX_DATA_SEQUENCED;
+    data.sequence = sequencer.next(key);
+  }
+  uint32_t header_size = mux_write_data_header(header, subtype, transfer_mode, session_id, data);
+  return transport->put_packet(owner, 1, channel, transfer_mode, header, header_size, body, data.length);
+}
+
+MuxError MuxSession::receive(int32_t sender, int32_t channel, const uint8_t *data, uint32_t size) {
+  if (transport == nullptr) {
+    return MUX_ERR_UNAVAILABLE;
+  }
+  // Data packets are routed by their header before their payload is touched
+  if (mux_is_data_subtype(data[0])) {
+    MuxRoute route;
+    MuxError error = mux_route_data(data, size, sender, header_forwarding && transport->is_server(), *this, route);
+    if (error == MUX_ERR_UNKNOWN_SOURCE && was_removed_from(route.source, sender)) {
+      // Sent before the host peer learnt the subpeer was removed
+      return MUX_ERR_UNKNOWN_SUBPEER;
+    }
+    if (error != MUX_OK) {
+      return error;
+    }
+    switch (route.action) {
+      case MUX_ROUTE_DROP:
+        return MUX_OK;
+      case MUX_ROUTE_FORWARD:
+        // The source was checked against its host peer, so the header goes out unchanged
+        return mux_put_packet(*transport, route.host_peer, channel, route.transfer_mode, data, size);
+      case MUX_ROUTE_FORWARD_AND_DELIVER:
+        // Broadcasts are forwarded to the other host peers as is, then delivered locally below
+        error = put_to_host_peers(data, size, nullptr, 0, sender, mux_broadcast_excluded(route.dest), channel, route.transfer_mode);
+        if (error != MUX_OK) {
+          return error;
+        }
+        break;
+      case MUX_ROUTE_DELIVER:
+        break;
+    }
+    if (!mux_accept_delivery(sequencer, data, size, route, channel)) {
+      // A newer packet of this stream was already delivered
+      return MUX_OK;
+    }
+    if (data[0] == MUX_DATA_DELTA) {
+      return receive_delta(sender, channel, route, data, size);
+    }
+    uint32_t header_size = mux_get_data_header_size(data[0]);
+    listener.deliver(route.source, route.dest, channel, route.transfer_mode, data + header_size, size - header_size);
+    return MUX_OK;
+  }
+  MultiplexPacketCommand command;
+  MuxError error = mux_read_command(data, size, command);
+  if (error != MUX_OK) {
+    return error;
+  }
+  if (command.subtype == MUX_CMD_DELTA_ACK) {
+    return receive_delta_ack(sender, data, size, command);
+  }
+  return transport->is_server() ? handle_command_dom(sender, command) : handle_command_sub(sender, command);
+}
+
+MuxError MuxSession::receive_delta(int32_t sender, int32_t channel, const MuxRoute &route, const uint8_t *data, uint32_t size) {
+  MultiplexPacketData header;
+  MuxError error = mux_read_data_header(data, size, header);
+  if (error != MUX_OK) {
+    return error;
+  }
+  MuxStreamKey key = { route.source, route.dest, channel };
+  const uint8_t *payload;
+  bool acknowledge = false;
+  error = delta.decode(key, header.sequence, header.baseline, header.decoded_length, data + MULTIPLEX_DELTA_HEADER_SIZE, header.length, payload, acknowledge);
+  if (error != MUX_OK) {
+    return error;
+  }
+  if (acknowledge) {
+    send_delta_ack(key, header.sequence, sender);
+  }
+  // From here on it is an ordinary payload
+  listener.deliver(route.source, route.dest, channel, route.transfer_mode, payload, header.decoded_length);
+  return MUX_OK;
+}
+
+MuxError MuxSession::receive_delta_ack(int32_t sender, const uint8_t *data, uint32_t size, const MultiplexPacketCommand &command) {
+  MuxStreamKey key = { command.subject_multiplex_peer, command.stream_dest, command.stream_channel };
+  if (transport->is_server()) {
+    // The acknowledging subpeer must belong to the host peer that sent the ack
+    int32_t owner;
+    bool known = get_subpeer_owner(key.dest, owner);
+    if (!known && was_removed_from(key.dest, sender)) {
+      return MUX_ERR_UNKNOWN_SUBPEER;
+    }
+    if (!known || owner != sender) {
+      return MUX_ERR_UNAUTHORIZED;
+    }
+    if (!local_subpeers.has(key.source)) {
+      // The stream was forwarded from another host peer, so is its ack
+      int32_t source_owner;
+      if (header_forwarding && get_subpeer_owner(key.source, source_owner) && source_owner != MUX_HOST_PEER_AWAY) {
+        return mux_put_packet(*transport, source_owner, 1, MUX_TRANSFER_MODE_UNRELIABLE, data, size);
+      }
+      return MUX_ERR_UNKNOWN_SUBPEER;
+    }
+  }
+  else if (!local_subpeers.has(key.source)) {
+    return MUX_ERR_UNKNOWN_SUBPEER;
+  }
+  delta.acknowledge(key, command.stream_sequence);
+  return MUX_OK;
+}
+
+// Rejected commands are returned rather than reported, so the demux can decide which of them count against the sender
+MuxError MuxSession::handle_command_dom(int32_t sender, const MultiplexPacketCommand &command) {
+  if (!local_subpeers.has(1)) {
+    // There is no server subpeer yet, or it has closed, so nobody can join or leave
+    return MUX_ERR_UNAVAILABLE;
+  }
+  int32_t subject = command.subject_multiplex_peer;
+  switch (command.subtype) {
+    case MUX_CMD_ADD_PEER: {
+      if (subject <= 0) {
+        // ids <= 0 address broadcasts
+        return MUX_ERR_INVALID;
+      }
+      // make sure no existing peer has the requested unique_id
+      if (has_subpeer(subject)) {
+        send_command(MUX_CMD_ERR_SUBPEER_ID_EXISTS, subject, sender);
+        return MUX_ERR_REFUSED;
+      }
+      // make sure the number of existing peers containing the sender's base pid is less than the max
+      uint32_t count = 0;
+      for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+        if (remote_subpeers.value_at(i) == sender) {
+          count++;
+        }
+      }
+      if (max_subpeers != 0 && count >= max_subpeers) {
+        send_command(MUX_CMD_ERR_SUBPEERS_EXCEEDED, subject, sender);
+        return MUX_ERR_REFUSED;
+      }
+      remote_subpeers.insert(subject, sender);
+      if (resume_grace_period_msec != 0 && !resume_tokens.has(sender)) {
+        uint64_t token = generate_resume_token();
+        resume_tokens.insert(sender, token);
+        send_resume_command(MUX_CMD_RESUME_TOKEN, token, sender);
+      }
+      if (header_forwarding) {
+        announce_subpeer(MUX_CMD_ADD_PEER, subject, sender);
+        if (count == 0) {
+          announce_known_subpeers_to(sender);
+        }
+      }
+      MuxError error = send_command(MUX_CMD_ADD_PEER_ACK, subject, sender);
+      listener.subpeer_connected(1, subject);
+      if (header_forwarding) {
+        notify_local_subpeers(true, subject);
+      }
+      return error;
+    }
+    case MUX_CMD_REMOVE_PEER: {
+      const int32_t *owner = remote_subpeers.getptr(subject);
+      if (owner == nullptr) {
+        // Crossed our own REMOVE_PEER on the way, anything else is a failed command
+        return was_removed_from(subject, sender) ? MUX_OK : MUX_ERR_REFUSED;
+      }
+      if (*owner != sender) {
+        return MUX_ERR_UNAUTHORIZED;
+      }
+      remove_remote_subpeer(subject, sender);
+      return MUX_OK;
+    }
+    case MUX_CMD_RESUME: {
+      SuspendedHost *suspended = suspended_hosts.getptr(command.resume_token);
+      if (suspended == nullptr) {
+        send_command(MUX_CMD_ERR_RESUME_REJECTED, 0, sender);
+        // Tokens are only presented once per reconnect, so repeated misses count against the host peer
+        return MUX_ERR_UNAUTHORIZED;
+      }
+      // Everything that changed while the host peer was away is sent ahead of RESUME_ACK
+      for (uint32_t i = 0; i < suspended->subpeers.size(); i++) {
+        int32_t subpeer = suspended->subpeers[i];
+        int32_t *owner = remote_subpeers.getptr(subpeer);
+        if (owner != nullptr && *owner == MUX_HOST_PEER_AWAY) {
+          *owner = sender;
+          // its ADD_PEER_ACK may have been lost with the connection
+          send_command(MUX_CMD_ADD_PEER_ACK, subpeer, sender);
+        }
+        else {
+          // kicked while its host peer was away
+          send_command(MUX_CMD_REMOVE_PEER, subpeer, sender);
+          remember_removed_subpeer(subpeer, sender);
+        }
+      }
+      if (header_forwarding) {
+        for (uint32_t i = 0; i < suspended->known_subpeers.size(); i++) {
+          if (!has_subpeer(suspended->known_subpeers[i])) {
+            send_command(MUX_CMD_REMOVE_PEER, suspended->known_subpeers[i], sender);
+          }
+        }
+        announce_known_subpeers_to(sender);
+      }
+      resume_tokens.insert(sender, command.resume_token);
+      suspended_hosts.erase(command.resume_token);
+      return send_command(MUX_CMD_RESUME_ACK, 0, sender);
+    }
+    default:
+      // only ever sent to clients
+      return MUX_ERR_INVALID;
+  }
+}
+
+MuxError MuxSession::handle_command_sub(int32_t sender, const MultiplexPacketCommand &command) {
+  int32_t subject = command.subject_multiplex_peer;
+  switch (command.subtype) {
+    case MUX_CMD_ADD_PEER:
+      // The server announces subpeers of other host peers when header forwarding is on, they are reached through it
+      if (subject <= 0 || has_subpeer(subject)) {
+        return MUX_OK;
+      }
+      remote_subpeers.insert(subject, sender);
+      if (header_forwarding) {
+        notify_local_subpeers(true, subject);
+      }
+      return MUX_OK;
+    case MUX_CMD_ADD_PEER_ACK: {
+      const bool *connected = local_subpeers.getptr(subject);
+      if (connected == nullptr) {
+        return MUX_ERR_UNKNOWN_SUBPEER;
+      }
+      pending_add_peers.erase(subject);
+      // A resume acknowledges every subpeer it restores, including ones that are connected already
+      if (!*connected) {
+        connect_local_subpeer(subject);
+      }
+      return MUX_OK;
+    }
+    case MUX_CMD_REMOVE_PEER:
+      if (subject == 1) {
+        // The server subpeer closed, the host peer stays connected for the server's other sessions
+        close_all_subpeers();
+        return MUX_OK;
+      }
+      if (remote_subpeers.erase(subject)) {
+        // A subpeer of another host peer has left
+        delta.forget(subject);
+        sequencer.forget(subject);
+        notify_local_subpeers(false, subject);
+        return MUX_OK;
+      }
+      if (!local_subpeers.has(subject)) {
+        return MUX_ERR_UNKNOWN_SUBPEER;
+      }
+      // The server removed one of ours, it already knows so nothing is sent back
+      drop_local_subpeer(subject);
+      if (header_forwarding) {
+        notify_local_subpeers(false, subject);
+      }
+      return MUX_OK;
+    case MUX_CMD_RESUME_TOKEN:
+      resume_token = command.resume_token;
+      return MUX_OK;
+    case MUX_CMD_RESUME_ACK: {
+      resuming = false;
+      for (uint32_t i = 0; i < closed_while_resuming.size(); i++) {
+        send_command(MUX_CMD_REMOVE_PEER, closed_while_resuming[i], 1);
+      }
+      closed_while_resuming.clear();
+      // Restored subpeers were acknowledged ahead of RESUME_ACK, the rest never reached the server
+      MuxArray<int32_t> to_add;
+      for (uint32_t i = local_subpeers.next(0); i < local_subpeers.capacity(); i = local_subpeers.next(i + 1)) {
+        if (!local_subpeers.value_at(i) && !pending_add_peers.has(local_subpeers.key_at(i))) {
+          to_add.push_back(local_subpeers.key_at(i));
+        }
+      }
+      for (uint32_t i = 0; i < to_add.size(); i++) {
+        request_add_peer(to_add[i]);
+      }
+      return MUX_OK;
+    }
+    case MUX_CMD_ERR_RESUME_REJECTED:
+      close_all_subpeers();
+      return MUX_OK;
+    case MUX_CMD_ERR_SUBPEERS_EXCEEDED:
+    case MUX_CMD_ERR_SUBPEER_ID_EXISTS:
+      pending_add_peers.erase(subject);
+      if (!local_subpeers.has(subject)) {
+        return MUX_ERR_UNKNOWN_SUBPEER;
+      }
+      drop_local_subpeer(subject);
+      return MUX_OK;
+    default:
+      // only ever sent to the server
+      return MUX_ERR_INVALID;
+  }
+}
+
+MuxError MuxSession::send_command(MultiplexPacketCommandSubtype subtype, int32_t subject, int32_t to_host_peer) {
+  // Commands only travel between host peers, offline there is nobody to tell
+  if (transport == nullptr) {
+    return MUX_OK;
+  }
+  MultiplexPacketCommand command = {};
+  command.subtype = subtype;
+  command.subject_multiplex_peer = subject;
+  return mux_put_command(*transport, to_host_peer, session_id, MUX_TRANSFER_MODE_RELIABLE, command);
+}
+
+MuxError MuxSession::send_resume_command(MultiplexPacketCommandSubtype subtype, uint64_t token, int32_t to_host_peer) {
+  if (transport == nullptr) {
+    return MUX_OK;
+  }
+  MultiplexPacketCommand command = {};
+  command.subtype = subtype;
+  command.resume_token = token;
+  return mux_put_command(*transport, to_host_peer, session_id, MUX_TRANSFER_MODE_RELIABLE, command);
+}
+
+MuxError MuxSession::send_delta_ack(const MuxStreamKey &key, uint16_t sequence, int32_t to_host_peer) {
+  MultiplexPacketCommand command = {};
+  command.subtype = MUX_CMD_DELTA_ACK;
+  command.subject_multiplex_peer = key.source;
+  command.stream_dest = key.dest;
+  command.stream_channel = key.channel;
+  command.stream_sequence = sequence;
+  // A lost ack only delays the next baseline, so it does not need to be reliable
+  return mux_put_command(*transport, to_host_peer, session_id, MUX_TRANSFER_MODE_UNRELIABLE, command);
+}
+
+MuxError MuxSession::request_add_peer(int32_t subpeer) {
+  // Remembered until it is answered, so a resume doesn't ask for the same subpeer twice
+  pending_add_peers.insert(subpeer, true);
+  return send_command(MUX_CMD_ADD_PEER, subpeer, 1);
+}
+
+MuxError MuxSession::put_to_host_peers(const uint8_t *header, uint32_t header_size, const uint8_t *payload, uint32_t payload_size, int32_t except_host_peer, int32_t excluded_subpeer, int32_t channel, MuxTransferMode transfer_mode) {
+  // A host peer is sent the packet once if it owns any subpeer that is not excluded
+  if (resuming) {
+    return MUX_OK;
+  }
+  fan_out_targets.clear();
+  fan_out_seen.clear();
+  fan_out_seen.insert(MUX_HOST_PEER_AWAY, true);
+  fan_out_seen.insert(except_host_peer, true);
+  fan_out_seen.insert(transport->get_unique_id(), true);
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    int32_t owner = remote_subpeers.value_at(i);
+    if (remote_subpeers.key_at(i) == excluded_subpeer || fan_out_seen.has(owner)) {
+      continue;
+    }
+    fan_out_seen.insert(owner, true);
+    fan_out_targets.push_back(owner);
+  }
+  if (fan_out_targets.is_empty()) {
+    return MUX_OK;
+  }
+  return transport->put_packet(fan_out_targets.ptr(), fan_out_targets.size(), channel, transfer_mode, header, header_size, payload, payload_size);
+}
+
+void MuxSession::collect_local_subpeers(MuxArray<int32_t> &r_subpeers, int32_t except_subpeer, bool only_connected) const {
+  // Subpeer 1 learns about subpeers through the usual add/remove handling, so it is never collected
+  for (uint32_t i = local_subpeers.next(0); i < local_subpeers.capacity(); i = local_subpeers.next(i + 1)) {
+    int32_t subpeer = local_subpeers.key_at(i);
+    if (subpeer != 1 && subpeer != except_subpeer && (!only_connected || local_subpeers.value_at(i))) {
+      r_subpeers.push_back(subpeer);
+    }
+  }
+}
+
+void MuxSession::notify_local_subpeers(bool connected, int32_t subpeer) {
+  MuxArray<int32_t> subpeers;
+  collect_local_subpeers(subpeers, subpeer, true);
+  for (uint32_t i = 0; i < subpeers.size(); i++) {
+    if (connected) {
+      listener.subpeer_connected(subpeers[i], subpeer);
+    }
+    else {
+      listener.subpeer_disconnected(subpeers[i], subpeer);
+    }
+  }
+}
+
+void MuxSession::introduce_local_subpeer(int32_t subpeer) {
+  // Without server relay every subpeer must be told about every other subpeer it can address
+  MuxArray<int32_t> locals;
+  collect_local_subpeers(locals, subpeer, true);
+  MuxArray<int32_t> remotes;
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    if (remote_subpeers.key_at(i) != 1) {
+      remotes.push_back(remote_subpeers.key_at(i));
+    }
+  }
+  if (transport != nullptr && transport->is_server()) {
+    announce_subpeer(MUX_CMD_ADD_PEER, subpeer, transport->get_unique_id());
+  }
+  for (uint32_t i = 0; i < locals.size(); i++) {
+    listener.subpeer_connected(locals[i], subpeer);
+    listener.subpeer_connected(subpeer, locals[i]);
+  }
+  for (uint32_t i = 0; i < remotes.size(); i++) {
+    listener.subpeer_connected(subpeer, remotes[i]);
+  }
+}
+
+void MuxSession::announce_subpeer(MultiplexPacketCommandSubtype subtype, int32_t subpeer, int32_t owner) {
+  // Every remote host peer that owns a subpeer is told once, except the one the subpeer belongs to
+  if (transport == nullptr) {
+    return;
+  }
+  fan_out_seen.clear();
+  fan_out_seen.insert(MUX_HOST_PEER_AWAY, true);
+  fan_out_seen.insert(owner, true);
+  fan_out_seen.insert(transport->get_unique_id(), true);
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    int32_t host_peer = remote_subpeers.value_at(i);
+    if (!fan_out_seen.has(host_peer)) {
+      fan_out_seen.insert(host_peer, true);
+      send_command(subtype, subpeer, host_peer);
+    }
+  }
+}
+
+void MuxSession::announce_known_subpeers_to(int32_t to_host_peer) {
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    if (remote_subpeers.value_at(i) != to_host_peer) {
+      send_command(MUX_CMD_ADD_PEER, remote_subpeers.key_at(i), to_host_peer);
+    }
+  }
+  for (uint32_t i = local_subpeers.next(0); i < local_subpeers.capacity(); i = local_subpeers.next(i + 1)) {
+    if (local_subpeers.key_at(i) != 1 && local_subpeers.value_at(i)) {
+      send_command(MUX_CMD_ADD_PEER, local_subpeers.key_at(i), to_host_peer);
+    }
+  }
+}
+
+void MuxSession::remember_removed_subpeer(int32_t subpeer, int32_t owner) {
+  // Only the server counts violations
+  if (transport == nullptr || !transport->is_server() || owner == MUX_HOST_PEER_AWAY) {
+    return;
+  }
+  uint64_t now = listener.get_ticks_msec();
+  MuxArray<int32_t> expired;
+  for (uint32_t i = removed_subpeers.next(0); i < removed_subpeers.capacity(); i = removed_subpeers.next(i + 1)) {
+    if (now >= removed_subpeers.value_at(i).expires_msec) {
+      expired.push_back(removed_subpeers.key_at(i));
+    }
+  }
+  for (uint32_t i = 0; i < expired.size(); i++) {
+    removed_subpeers.erase(expired[i]);
+  }
+  RemovedSubpeer removed;
+  removed.owner = owner;
+  removed.expires_msec = now + MUX_REMOVED_SUBPEER_MSEC;
+  removed_subpeers.insert(subpeer, removed);
+}
+
+bool MuxSession::was_removed_from(int32_t subpeer, int32_t host_peer) const {
+  const RemovedSubpeer *removed = removed_subpeers.getptr(subpeer);
+  return removed != nullptr && removed->owner == host_peer && listener.get_ticks_msec() < removed->expires_msec;
+}
+
+void MuxSession::forget_remote_subpeer(int32_t subpeer, int32_t owner) {
+  remote_subpeers.erase(subpeer);
+  remember_removed_subpeer(subpeer, owner);
+  delta.forget(subpeer);
+  sequencer.forget(subpeer);
+  if (header_forwarding) {
+    announce_subpeer(MUX_CMD_REMOVE_PEER, subpeer, owner);
+    notify_local_subpeers(false, subpeer);
+  }
+}
+
+void MuxSession::remove_remote_subpeer(int32_t subpeer, int32_t owner) {
+  forget_remote_subpeer(subpeer, owner);
+  if (local_subpeers.has(1)) {
+    listener.subpeer_disconnected(1, subpeer);
+  }
+}
+
+void MuxSession::remove_subpeers_of(int32_t host_peer) {
+  MuxArray<int32_t> subpeers;
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    if (remote_subpeers.value_at(i) == host_peer) {
+      subpeers.push_back(remote_subpeers.key_at(i));
+    }
+  }
+  for (uint32_t i = 0; i < subpeers.size(); i++) {
+    const int32_t *owner = remote_subpeers.getptr(subpeers[i]);
+    if (owner != nullptr && *owner == host_peer) {
+      remove_remote_subpeer(subpeers[i], host_peer);
+    }
+  }
+}
+
+void MuxSession::drop_local_subpeer(int32_t subpeer) {
+  // The session let go of a local subpeer that did not ask to leave
+  local_subpeers.erase(subpeer);
+  pending_add_peers.erase(subpeer);
+  delta.forget(subpeer);
+  sequencer.forget(subpeer);
+  listener.subpeer_disconnected(subpeer, 1);
+  listener.local_subpeer_closed(subpeer);
+}
+
+void MuxSession::close_all_subpeers() {
+  MuxArray<int32_t> subpeers;
+  for (uint32_t i = local_subpeers.next(0); i < local_subpeers.capacity(); i = local_subpeers.next(i + 1)) {
+    subpeers.push_back(local_subpeers.key_at(i));
+  }
+  local_subpeers.clear();
+  remote_subpeers.clear();
+  delta.clear();
+  sequencer.clear();
+  pending_add_peers.clear();
+  closed_while_resuming.clear();
+  resuming = false;
+  resume_token = 0;
+  for (uint32_t i = 0; i < subpeers.size(); i++) {
+    if (subpeers[i] != 1) {
+      listener.subpeer_disconnected(subpeers[i], 1);
+    }
+    listener.local_subpeer_closed(subpeers[i]);
+  }
+}
+
+void MuxSession::suspend_host_peer(int32_t host_peer) {
+  // Nobody is told the subpeers left, they keep their ids until the host peer resumes or the grace period ends
+  uint64_t token = *resume_tokens.getptr(host_peer);
+  resume_tokens.erase(host_peer);
+  SuspendedHost &suspended = suspended_hosts.insert(token, SuspendedHost());
+  suspended.expires_msec = listener.get_ticks_msec() + resume_grace_period_msec;
+  for (uint32_t i = remote_subpeers.next(0); i < remote_subpeers.capacity(); i = remote_subpeers.next(i + 1)) {
+    if (remote_subpeers.value_at(i) == host_peer) {
+      suspended.subpeers.push_back(remote_subpeers.key_at(i));
+    }
+    else if (header_forwarding) {
+      // what the host peer was told about, so the ones that leave before it resumes can be removed on its side
+      suspended.known_subpeers.push_back(remote_subpeers.key_at(i));
+    }
+  }
+  if (header_forwarding) {
+    collect_local_subpeers(suspended.known_subpeers, 1, true);
+  }
+  for (uint32_t i = 0; i < suspended.subpeers.size(); i++) {
+    *remote_subpeers.getptr(suspended.subpeers[i]) = MUX_HOST_PEER_AWAY;
+  }
+}
+
+uint64_t MuxSession::generate_resume_token() {
+  uint64_t token = 0;
+  while (token == 0 || suspended_hosts.has(token)) {
+    token = listener.generate_random_u64();
+  }
+  return token;
+}
@@ -0,0 +1,155 @@
+#ifndef MUX_SESSION_H
+#define MUX_SESSION_H
+#include "mux_delta.h"
+#include "mux_router.h"
+#include "mux_sequence.h"
+#include "mux_table.h"
+#include "mux_transport.h"
+#include "mux_wire.h"
+#include <cstdint>
+
+// how long packets still on their way from a removed subpeer are dropped without counting against its host peer
+#define MUX_REMOVED_SUBPEER_MSEC 5000
+
+// What a MuxSession tells the code embedding it. In Godot this is MultiplexNetwork, which turns these into
+// MultiplexPeer signals and packet queues. The session's tables are already updated when a callback runs.
+class MuxSessionListener {
+public:
+	virtual ~MuxSessionListener() {}
+	// local subpeer to_subpeer should see peer_connected(subpeer)
+	virtual void subpeer_connected(int32_t to_subpeer, int32_t subpeer) = 0;
+	// local subpeer to_subpeer should see peer_disconnected(subpeer)
+	virtual void subpeer_disconnected(int32_t to_subpeer, int32_t subpeer) = 0;
+	// a local subpeer finished connecting
+	virtual void local_subpeer_connected(int32_t subpeer) = 0;
+	// the session dropped a local subpeer (refused, kicked or the server left), it is already forgotten
+	virtual void local_subpeer_closed(int32_t subpeer) = 0;
+	// A payload for local subpeer dest, or for every local subpeer except source and -dest when dest <= 0.
+	// payload is only valid during the call.
+	virtual void deliver(int32_t source, int32_t dest, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *payload, uint32_t length) = 0;
+	virtual uint64_t get_ticks_msec() = 0;
+	// Anyone holding a resume token can take over its subpeers, so it must come from a CSPRNG
+	virtual uint64_t generate_random_u64() = 0;
+};
+
+// MuxSession is one session's subpeer id space: which subpeers are local and which host peer owns each remote
+// one, the ADD_PEER / REMOVE_PEER / RESUME handshakes, and per stream sequencing and delta encoding.
+// It is everything a MultiplexNetwork does apart from being a Godot object, so a relay can run sessions
+// without Godot by implementing MuxTransport and MuxSessionListener.
+//
+// Without a transport the session is offline and is its own server, subpeers only reach each other.
+class MuxSession : public MuxDirectory {
+private:
+	MuxSessionListener &listener;
+	MuxTransport *transport = nullptr;
+	uint16_t session_id = 0; // written into every packet, selects this session on the remote demux
+	uint32_t max_subpeers = 0; // per host peer, 0 = inf
+	bool header_forwarding = false; // subpeers address each other directly, the server forwards their packets without unpacking them
+	bool delta_encoding = false; // unreliable packets to remote subpeers are encoded against earlier packets of the same stream
+	MuxTable<int32_t, bool> local_subpeers; // subpeer -> connected
+	MuxTable<int32_t, int32_t> remote_subpeers; // subpeer -> owner host peer, MUX_HOST_PEER_AWAY while suspended
+	MuxSequencer sequencer; // numbers unreliable ordered and delta packets per stream, drops stale ordered ones
+	MuxDeltaCodec delta;
+	// Resume keeps subpeers alive across a host peer reconnect, 0 = disabled
+	struct SuspendedHost {
+		uint64_t expires_msec = 0;
+		MuxArray<int32_t> subpeers;
+		MuxArray<int32_t> known_subpeers; // header forwarding: subpeers of others the host peer had been told about
+	};
+	uint32_t resume_grace_period_msec = 0;
+	MuxTable<int32_t, uint64_t> resume_tokens; // server: host peer -> token
+	MuxTable<uint64_t, SuspendedHost> suspended_hosts; // server: token -> subpeers waiting for their host peer to come back
+	uint64_t resume_token = 0; // client: token issued by the server, 0 = none
+	bool resuming = false; // client: the server dropped and our subpeers are waiting for it
+	uint64_t resume_expires_msec = 0;
+	MuxArray<int32_t> closed_while_resuming; // client: told to the server once it is back
+	MuxTable<int32_t, bool> pending_add_peers; // client: ADD_PEER sent on the current connection and not answered yet
+	struct RemovedSubpeer {
+		int32_t owner = 0;
+		uint64_t expires_msec = 0;
+	};
+	MuxTable<int32_t, RemovedSubpeer> removed_subpeers; // server: subpeers removed in the last MUX_REMOVED_SUBPEER_MSEC
+	// reused by every broadcast
+	MuxArray<int32_t> fan_out_targets;
+	MuxTable<int32_t, bool> fan_out_seen;
+	MuxSession(const MuxSession &);
+	MuxSession &operator=(const MuxSession &);
+
+	MuxError send_command(MultiplexPacketCommandSubtype subtype, int32_t subject, int32_t to_host_peer);
+	MuxError send_resume_command(MultiplexPacketCommandSubtype subtype, uint64_t token, int32_t to_host_peer);
+	MuxError send_delta_ack(const MuxStreamKey &key, uint16_t sequence, int32_t to_host_peer);
+	MuxError request_add_peer(int32_t subpeer);
+	MuxError put_to_host_peers(const uint8_t *header, uint32_t header_size, const uint8_t *payload, uint32_t payload_size, int32_t except_host_peer, int32_t excluded_subpeer, int32_t channel, MuxTransferMode transfer_mode);
+	void collect_local_subpeers(MuxArray<int32_t> &r_subpeers, int32_t except_subpeer, bool only_connected) const;
+	void notify_local_subpeers(bool connected, int32_t subpeer);
+	void introduce_local_subpeer(int32_t subpeer);
+	void announce_subpeer(MultiplexPacketCommandSubtype subtype, int32_t subpeer, int32_t owner);
+	void announce_known_subpeers_to(int32_t to_host_peer);
+	void remember_removed_subpeer(int32_t subpeer, int32_t owner);
+	bool was_removed_from(int32_t subpeer, int32_t host_peer) const;
+	void remove_remote_subpeer(int32_t subpeer, int32_t owner);
+	void remove_subpeers_of(int32_t host_peer);
+	void drop_local_subpeer(int32_t subpeer);
+	void close_all_subpeers();
+	void suspend_host_peer(int32_t host_peer);
+	uint64_t generate_resume_token();
+	MuxError handle_command_dom(int32_t sender, const MultiplexPacketCommand &command);
+	MuxError handle_command_sub(int32_t sender, const MultiplexPacketCommand &command);
+	MuxError receive_delta_ack(int32_t sender, const uint8_t *data, uint32_t size, const MultiplexPacketCommand &command);
+	MuxError receive_delta(int32_t sender, int32_t channel, const MuxRoute &route, const uint8_t *data, uint32_t size);
+	void forget_remote_subpeer(int32_t subpeer, int32_t owner);
+	void end_session();
+
+public:
+	MuxSession(MuxSessionListener &listener) : listener(listener) {}
+	void set_session_id(uint16_t session_id);
+	uint16_t get_session_id() const;
+	void set_max_subpeers(uint32_t max_subpeers);
+	uint32_t get_max_subpeers() const;
+	void set_header_forwarding(bool enabled);
+	bool is_header_forwarding() const;
+	void set_delta_encoding(bool enabled);
+	bool is_delta_encoding() const;
+	void set_resume_grace_period_msec(uint32_t grace_period_msec);
+	uint32_t get_resume_grace_period_msec() const;
+
+	// null takes the session offline, subpeers it knows stay known
+	void attach(MuxTransport *transport);
+	// forgets every subpeer without telling anyone
+	void reset();
+	bool is_offline() const;
+	bool is_server() const;
+	int32_t get_local_host_peer_id() const;
+	bool is_resuming() const;
+
+	bool has_local_subpeer(int32_t subpeer) const override;
+	bool get_subpeer_owner(int32_t subpeer, int32_t &r_host_peer) const override;
+	bool has_subpeer(int32_t subpeer) const;
+	bool is_remote_subpeer(int32_t subpeer) const;
+	// -1 if the subpeer is unknown
+	int32_t get_subpeer_host_peer(int32_t subpeer) const;
+	// a local subpeer connects without waiting for the server, true next to the server and offline once subpeer 1 exists
+	bool connects_locally() const;
+
+	// Subpeer 1 is connected as soon as it is added, a client asks the server for any other subpeer
+	MuxError add_local_subpeer(int32_t subpeer);
+	// completes a local subpeer's connection, see connects_locally
+	void connect_local_subpeer(int32_t subpeer);
+	// Closing subpeer 1 ends the session, every remote host peer is told so the session can be detached
+	// from a shared transport. Any other subpeer is removed from the server.
+	void close_local_subpeer(int32_t subpeer);
+	// server: removes a remote subpeer and tells its host peer
+	void kick_subpeer(int32_t subpeer);
+
+	void host_peer_connected(int32_t host_peer);
+	void host_peer_disconnected(int32_t host_peer);
+	// ends grace periods that ran out, call it regularly when resume is enabled
+	void update();
+
+	// dest is a subpeer, or every subpeer except -dest when dest <= 0. MUX_ERR_UNKNOWN_SUBPEER if dest isn't known.
+	MuxError send(int32_t source, int32_t dest, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *payload, uint32_t length);
+	// Handles a packet for this session that passed mux_validate. Rejections are returned without side effects
+	// on the caller, MuxDemux decides which of them count against sender.
+	MuxError receive(int32_t sender, int32_t channel, const uint8_t *data, uint32_t size);
+};
+#endif
@@ -0,0 +1,277 @@
+#ifndef MUX_TABLE_H
+#define MUX_TABLE_H
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+// The two containers the core keeps its state in, so it needs neither godot-cpp nor the STL.
+// Both copy their elements, so big values are better stored by pointer.
+
+// A growable array
+template <class T>
+class MuxArray {
+private:
+	T *data = nullptr;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	void reserve(uint32_t wanted) {
+		if (wanted <= capacity) {
+			return;
+		}
+		uint32_t new_capacity = capacity == 0 ? 8 : capacity;
+		while (new_capacity < wanted) {
+			new_capacity *= 2;
+		}
+		T *new_data = new T[new_capacity];
+		for (uint32_t i = 0; i < count; i++) {
+			new_data[i] = data[i];
+		}
+		delete[] data;
+		data = new_data;
+		capacity = new_capacity;
+	}
+
+public:
+	MuxArray() {}
+	MuxArray(const MuxArray &other) {
+		*this = other;
+	}
+	MuxArray &operator=(const MuxArray &other) {
+		if (this != &other) {
+			count = 0;
+			reserve(other.count);
+			for (uint32_t i = 0; i < other.count; i++) {
+				data[i] = other.data[i];
+			}
+			count = other.count;
+		}
+		return *this;
+	}
+	~MuxArray() {
+		delete[] data;
+	}
+	uint32_t size() const {
+		return count;
+	}
+	bool is_empty() const {
+		return count == 0;
+	}
+	T *ptr() {
+		return data;
+	}
+	const T *ptr() const {
+		return data;
+	}
+	T &operator[](uint32_t index) {
+		return data[index];
+	}
+	const T &operator[](uint32_t index) const {
+		return data[index];
+	}
+	void push_back(const T &value) {
+		reserve(count + 1);
+		data[count++] = value;
+	}
+	// new elements are left as they are, which for bytes means uninitialized
+	void resize(uint32_t new_count) {
+		reserve(new_count);
+		count = new_count;
+	}
+	bool has(const T &value) const {
+		for (uint32_t i = 0; i < count; i++) {
+			if (data[i] == value) {
+				return true;
+			}
+		}
+		return false;
+	}
+	void swap(MuxArray &other) {
+		T *other_data = other.data;
+		uint32_t other_count = other.count;
+		uint32_t other_capacity = other.capacity;
+		other.data = data;
+		other.count = count;
+		other.capacity = capacity;
+		data = other_data;
+		count = other_count;
+		capacity = other_capacity;
+	}
+	// keeps the memory for the next use
+	void clear() {
+		count = 0;
+	}
+};
+
+static inline uint32_t mux_hash_u32(uint32_t value) {
+	// murmur3's finalizer
+	value ^= value >> 16;
+	value *= 0x85EBCA6Bu;
+	value ^= value >> 13;
+	value *= 0xC2B2AE35u;
+	value ^= value >> 16;
+	return value;
+}
+
+struct MuxIntHasher {
+	static uint32_t hash(int32_t value) {
+		return mux_hash_u32((uint32_t)value);
+	}
+	static uint32_t hash(uint16_t value) {
+		return mux_hash_u32(value);
+	}
+	static uint32_t hash(uint64_t value) {
+		return mux_hash_u32((uint32_t)value ^ mux_hash_u32((uint32_t)(value >> 32)));
+	}
+};
+
+// An open addressing hash map with linear probing. Erasing moves later entries back instead of leaving
+// tombstones, so lookups stay short no matter how often subpeers come and go.
+// Iterate with `for (uint32_t i = table.next(0); i < table.capacity(); i = table.next(i + 1))`. The table
+// must not change while it is iterated, collect the keys first when entries are erased on the way.
+template <class K, class V, class H = MuxIntHasher>
+class MuxTable {
+private:
+	struct Slot {
+		K key;
+		V value;
+		bool used = false;
+	};
+	Slot *slots = nullptr;
+	uint32_t slot_count = 0; // a power of two, or 0
+	uint32_t count = 0;
+	void grow() {
+		Slot *old_slots = slots;
+		uint32_t old_count = slot_count;
+		slot_count = slot_count == 0 ? 8 : slot_count * 2;
+		slots = new Slot[slot_count];
+		count = 0;
+		for (uint32_t i = 0; i < old_count; i++) {
+			if (old_slots[i].used) {
+				insert(old_slots[i].key, old_slots[i].value);
+			}
+		}
+		delete[] old_slots;
+	}
+	uint32_t find(const K &key) const {
+		if (count == 0) {
+			return slot_count;
+		}
+		uint32_t mask = slot_count - 1;
+		for (uint32_t i = H::hash(key) & mask;; i = (i + 1) & mask) {
+			if (!slots[i].used) {
+				return slot_count;
+			}
+			if (slots[i].key == key) {
+				return i;
+			}
+		}
+	}
+
+public:
+	MuxTable() {}
+	MuxTable(const MuxTable &other) {
+		*this = other;
+	}
+	MuxTable &operator=(const MuxTable &other) {
+		if (this != &other) {
+			delete[] slots;
+			slots = nullptr;
+			slot_count = 0;
+			count = 0;
+			for (uint32_t i = other.next(0); i < other.capacity(); i = other.next(i + 1)) {
+				insert(other.key_at(i), other.value_at(i));
+			}
+		}
+		return *this;
+	}
+	~MuxTable() {
+		delete[] slots;
+	}
+	uint32_t size() const {
+		return count;
+	}
+	bool is_empty() const {
+		return count == 0;
+	}
+	bool has(const K &key) const {
+		return find(key) != slot_count;
+	}
+	V *getptr(const K &key) {
+		uint32_t i = find(key);
+		return i == slot_count ? nullptr : &slots[i].value;
+	}
+	const V *getptr(const K &key) const {
+		uint32_t i = find(key);
+		return i == slot_count ? nullptr : &slots[i].value;
+	}
+	// overwrites the value of a key that is already there
+	V &insert(const K &key, const V &value) {
+		uint32_t i = find(key);
+		if (i != slot_count) {
+			slots[i].value = value;
+			return slots[i].value;
+		}
+		// at most three quarters full
+		if ((count + 1) * 4 > slot_count * 3) {
+			grow();
+		}
+		uint32_t mask = slot_count - 1;
+		for (i = H::hash(key) & mask; slots[i].used; i = (i + 1) & mask) {
+		}
+		slots[i].key = key;
+		slots[i].value = value;
+		slots[i].used = true;
+		count++;
+		return slots[i].value;
+	}
+	bool erase(const K &key) {
+		uint32_t i = find(key);
+		if (i == slot_count) {
+			return false;
+		}
+		uint32_t mask = slot_count - 1;
+		// every later entry of the probe run that could live in the hole moves back into it
+		for (uint32_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+			uint32_t home = H::hash(slots[j].key) & mask;
+			if (((j - home) & mask) >= ((j - i) & mask)) {
+				slots[i].key = slots[j].key;
+				slots[i].value = slots[j].value;
+				i = j;
+			}
+		}
+		slots[i].used = false;
+		slots[i].value = V();
+		count--;
+		return true;
+	}
+	// keeps the memory for the next use
+	void clear() {
+		for (uint32_t i = 0; i < slot_count; i++) {
+			if (slots[i].used) {
+				slots[i].used = false;
+				slots[i].value = V();
+			}
+		}
+		count = 0;
+	}
+	uint32_t capacity() const {
+		return slot_count;
+	}
+	// the first used slot at or after index, capacity() if there is none
+	uint32_t next(uint32_t index) const {
+		while (index < slot_count && !slots[index].used) {
+			index++;
+		}
+		return index;
+	}
+	const K &key_at(uint32_t index) const {
+		return slots[index].key;
+	}
+	V &value_at(uint32_t index) {
+		return slots[index].value;
+	}
+	const V &value_at(uint32_t index) const {
+		return slots[index].value;
+	}
+};
+#endif
@@ -0,0 +1,11 @@
+#include "mux_transport.h"
+
+MuxError mux_put_packet(MuxTransport &transport, int32_t target_host_peer, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *data, uint32_t size) {
+  return transport.put_packet(&target_host_peer, 1, channel, transfer_mode, data, size, nullptr, 0);
+}
+
+MuxError mux_put_command(MuxTransport &transport, int32_t target_host_peer, uint16_t session, MuxTransferMode transfer_mode, const MultiplexPacketCommand &command) {
+  uint8_t out[MULTIPLEX_CMD_MAX_SIZE];
+  uint32_t size = mux_write_command(out, transfer_mode, session, command);
+  return mux_put_packet(transport, target_host_peer, 1, transfer_mode, out, size);
+}
@@ -0,0 +1,25 @@
+#ifndef MUX_TRANSPORT_H
+#define MUX_TRANSPORT_H
+#include "mux_wire.h"
+#include <cstdint>
+
+// What the core needs from whatever carries its packets between host peers.
+// In Godot this is MultiplexHostPeerAdapter over a MultiplayerPeer, a relay service can implement it over its own sockets.
+class MuxTransport {
+public:
+	virtual ~MuxTransport() {}
+	virtual int32_t get_unique_id() const = 0;
+	virtual bool is_server() const = 0;
+	// connected to the server, a server is always connected
+	virtual bool is_connected() const = 0;
+	// Sends header followed by payload to each of the count targets. The packet is split so the core never copies
+	// a payload to put a header in front of it, and there may be many targets so a transport that has to build a
+	// buffer builds it once. payload may be null when header is the whole packet. Both are only read during the call.
+	virtual MuxError put_packet(const int32_t *targets, uint32_t count, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *header, uint32_t header_size, const uint8_t *payload, uint32_t payload_size) = 0;
+};
+
+// sends a whole packet to a single host peer
+MuxError mux_put_packet(MuxTransport &transport, int32_t target_host_peer, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *data, uint32_t size);
+// Writes command into a stack buffer and sends it to target_host_peer on channel 1, where commands always go
+MuxError mux_put_command(MuxTransport &transport, int32_t target_host_peer, uint16_t session, MuxTransferMode transfer_mode, const MultiplexPacketCommand &command);
+#endif
@@ -0,0 +1,232 @@
+#include "mux_wire.h"
+
+static inline uint16_t read_u16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t read_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t read_u64(const uint8_t *p) {
+  return (uint64_t)read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+}
+
+static inline void write_u16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void write_u32(uint8_t *p, uint32_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+}
+
+static inline void write_u64(uint8_t *p, uint64_t value) {
+  write_u32(p, (uint32_t)value);
+  write_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+bool mux_is_data_subtype(uint8_t subtype) {
+  return subtype == MUX_DATA || subtype == MUX_DATA_SEQUENCED || subtype == MUX_DATA_DELTA;
+}
+
+bool mux_is_valid_command_subtype(uint8_t command_subtype) {
+  switch (command_subtype) {
+    case MUX_CMD_ADD_PEER:
+    case MUX_CMD_ADD_PEER_ACK:
+    case MUX_CMD_ERR_SUBPEERS_EXCEEDED:
+    case MUX_CMD_ERR_SUBPEER_ID_EXISTS:
+    case MUX_CMD_REMOVE_PEER:
+    case MUX_CMD_RESUME_TOKEN:
+    case MUX_CMD_RESUME:
+    case MUX_CMD_RESUME_ACK:
+    case MUX_CMD_ERR_RESUME_REJECTED:
+    case MUX_CMD_DELTA_ACK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t mux_get_command_size(uint8_t command_subtype) {
+  switch (command_subtype) {
+    case MUX_CMD_DELTA_ACK:
+      return MULTIPLEX_CMD_DELTA_ACK_SIZE;
+    case MUX_CMD_RESUME_TOKEN:
+    case MUX_CMD_RESUME:
+      return MULTIPLEX_CMD_RESUME_SIZE;
+    default:
+      return MULTIPLEX_CMD_SIZE;
+  }
+}
+
+uint32_t mux_get_data_header_size(uint8_t subtype) {
+  switch (subtype) {
+    case MUX_DATA_DELTA:
+      return MULTIPLEX_DELTA_HEADER_SIZE;
+    case MUX_DATA_SEQUENCED:
+      return MULTIPLEX_SEQUENCED_HEADER_SIZE;
+    default:
+      return MULTIPLEX_DATA_HEADER_SIZE;
+  }
+}
+
+MuxError mux_validate(const uint8_t *data, uint32_t size) {
+  // Runs on every received packet, including junk, so failures are only reported by the caller
+  if (size < 2) {
+    return MUX_ERR_PARSE;
+  }
+  if (data[1] > MUX_TRANSFER_MODE_RELIABLE) {
+    return MUX_ERR_PARSE;
+  }
+  switch (data[0]) {
+    case MUX_DATA:
+    case MUX_DATA_SEQUENCED: {
+      uint32_t header_size = mux_get_data_header_size(data[0]);
+      if (size < header_size || size > MAX_MULTIPLEX_PACKET_SIZE) {
+        return MUX_ERR_PARSE;
+      }
+      if (read_u32(data + 4) != size - header_size) {
+        return MUX_ERR_PARSE;
+      }
+      return MUX_OK;
+    }
+    case MUX_DATA_DELTA: {
+      if (size < MULTIPLEX_DELTA_HEADER_SIZE || size > MAX_MULTIPLEX_PACKET_SIZE) {
+        return MUX_ERR_PARSE;
+      }
+      if (read_u32(data + 4) != size - MULTIPLEX_DELTA_HEADER_SIZE || read_u32(data + 20) > MAX_MULTIPLEX_PACKET_SIZE - MULTIPLEX_DATA_HEADER_SIZE) {
+        return MUX_ERR_PARSE;
+      }
+      return MUX_OK;
+    }
+    case MUX_CMD: {
+      if (size < MULTIPLEX_CMD_SIZE) {
+        return MUX_ERR_PARSE;
+      }
+      if (!mux_is_valid_command_subtype(data[4]) || size != mux_get_command_size(data[4])) {
+        return MUX_ERR_PARSE;
+      }
+      return MUX_OK;
+    }
+    default:
+      return MUX_ERR_PARSE;
+  }
+}
+
+MuxError mux_peek_session(const uint8_t *data, uint32_t size, uint16_t &r_session) {
+  if (size < 4) {
+    return MUX_ERR_PARSE;
+  }
+  r_session = read_u16(data + 2);
+  return MUX_OK;
+}
+
+MuxError mux_peek_data_header(const uint8_t *data, uint32_t size, uint8_t &r_transfer_mode, int32_t &r_source, int32_t &r_dest) {
+  if (size < MULTIPLEX_DATA_HEADER_SIZE || !mux_is_data_subtype(data[0])) {
+    return MUX_ERR_PARSE;
+  }
+  r_transfer_mode = data[1];
+  r_source = (int32_t)read_u32(data + 8);
+  r_dest = (int32_t)read_u32(data + 12);
+  return MUX_OK;
+}
+
+MuxError mux_peek_sequence(const uint8_t *data, uint32_t size, uint16_t &r_sequence) {
+  if (size < MULTIPLEX_SEQUENCED_HEADER_SIZE || (data[0] != MUX_DATA_SEQUENCED && data[0] != MUX_DATA_DELTA)) {
+    return MUX_ERR_PARSE;
+  }
+  // both keep the sequence right after the MUX_DATA header
+  r_sequence = read_u16(data + 16);
+  return MUX_OK;
+}
+
+uint32_t mux_write_data_header(uint8_t *out, uint8_t subtype, uint8_t transfer_mode, uint16_t session, const MultiplexPacketData &data) {
+  out[0] = subtype;
+  out[1] = transfer_mode;
+  write_u16(out + 2, session);
+  write_u32(out + 4, data.length);
+  write_u32(out + 8, (uint32_t)data.mux_peer_source);
+  write_u32(out + 12, (uint32_t)data.mux_peer_dest);
+  if (subtype == MUX_DATA_SEQUENCED) {
+    write_u16(out + 16, data.sequence);
+  }
+  else if (subtype == MUX_DATA_DELTA) {
+    write_u16(out + 16, data.sequence);
+    write_u16(out + 18, data.baseline);
+    write_u32(out + 20, data.decoded_length);
+  }
+  return mux_get_data_header_size(subtype);
+}
+
+MuxError mux_read_data_header(const uint8_t *data, uint32_t size, MultiplexPacketData &r_data) {
+  if (size < 1 || !mux_is_data_subtype(data[0])) {
+    return MUX_ERR_PARSE;
+  }
+  uint32_t header_size = mux_get_data_header_size(data[0]);
+  if (size < header_size) {
+    return MUX_ERR_PARSE;
+  }
+  r_data.length = read_u32(data + 4);
+  r_data.mux_peer_source = (int32_t)read_u32(data + 8);
+  r_data.mux_peer_dest = (int32_t)read_u32(data + 12);
+  // Length and packet size mismatch could imply someone is trying to do a buffer overrun attack
+  if (r_data.length != size - header_size) {
+    return MUX_ERR_INVALID;
+  }
+  if (data[0] == MUX_DATA_DELTA) {
+    r_data.sequence = read_u16(data + 16);
+    r_data.baseline = read_u16(data + 18);
+    r_data.decoded_length = read_u32(data + 20);
+  }
+  else {
+    if (data[0] == MUX_DATA_SEQUENCED) {
+      r_data.sequence = read_u16(data + 16);
+    }
+    r_data.decoded_length = r_data.length;
+  }
+  if (r_data.decoded_length > MAX_MULTIPLEX_PACKET_SIZE - MULTIPLEX_DATA_HEADER_SIZE) {
+    return MUX_ERR_INVALID;
+  }
+  return MUX_OK;
+}
+
+uint32_t mux_write_command(uint8_t *out, uint8_t transfer_mode, uint16_t session, const MultiplexPacketCommand &command) {
+  out[0] = MUX_CMD;
+  out[1] = transfer_mode;
+  write_u16(out + 2, session);
+  out[4] = command.subtype;
+  write_u32(out + 5, (uint32_t)command.subject_multiplex_peer);
+  if (command.subtype == MUX_CMD_DELTA_ACK) {
+    write_u32(out + 9, (uint32_t)command.stream_dest);
+    write_u32(out + 13, (uint32_t)command.stream_channel);
+    write_u16(out + 17, command.stream_sequence);
+  }
+  else if (command.subtype == MUX_CMD_RESUME_TOKEN || command.subtype == MUX_CMD_RESUME) {
+    write_u64(out + 9, command.resume_token);
+  }
+  return mux_get_command_size(command.subtype);
+}
+
+MuxError mux_read_command(const uint8_t *data, uint32_t size, MultiplexPacketCommand &r_command) {
+  if (size < MULTIPLEX_CMD_SIZE || data[0] != MUX_CMD) {
+    return MUX_ERR_PARSE;
+  }
+  if (!mux_is_valid_command_subtype(data[4]) || size != mux_get_command_size(data[4])) {
+    return MUX_ERR_PARSE;
+  }
+  r_command.subtype = (MultiplexPacketCommandSubtype)data[4];
+  r_command.subject_multiplex_peer = (int32_t)read_u32(data + 5);
+  if (r_command.subtype == MUX_CMD_DELTA_ACK) {
+    r_command.stream_dest = (int32_t)read_u32(data + 9);
+    r_command.stream_channel = (int32_t)read_u32(data + 13);
+    r_command.stream_sequence = read_u16(data + 17);
+  }
+  else if (r_command.subtype == MUX_CMD_RESUME_TOKEN || r_command.subtype == MUX_CMD_RESUME) {
+    r_command.resume_token = read_u64(data + 9);
+  }
+  return MUX_OK;
+}
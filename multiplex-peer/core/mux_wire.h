@@ -0,0 +1,162 @@
+#ifndef MUX_WIRE_H
+#define MUX_WIRE_H
+#include <cstdint>
+
+// The multiplex wire format, free of godot-cpp so it can be used by relays, fuzzers and benchmarks.
+// Every function works on plain byte spans and never allocates.
+
+// size of a steam packet minus some overhead.
+#define MAX_MULTIPLEX_PACKET_SIZE 522288
+
+// serialized header sizes, see the layout below
+#define MULTIPLEX_DATA_HEADER_SIZE 16
+#define MULTIPLEX_SEQUENCED_HEADER_SIZE 18
+#define MULTIPLEX_DELTA_HEADER_SIZE 24
+#define MULTIPLEX_CMD_SIZE 9
+#define MULTIPLEX_CMD_DELTA_ACK_SIZE 19
+#define MULTIPLEX_CMD_RESUME_SIZE 17
+#define MULTIPLEX_CMD_MAX_SIZE MULTIPLEX_CMD_DELTA_ACK_SIZE
+
+// Same values as godot::MultiplayerPeer::TransferMode
+enum MuxTransferMode : uint8_t {
+	MUX_TRANSFER_MODE_UNRELIABLE = 0,
+	MUX_TRANSFER_MODE_UNRELIABLE_ORDERED = 1,
+	MUX_TRANSFER_MODE_RELIABLE = 2
+};
+
+enum MuxError {
+	MUX_OK = 0,
+	MUX_ERR_PARSE, // malformed packet
+	MUX_ERR_UNKNOWN_SUBPEER, // the subpeer a packet is for isn't known, expected for a while after it left
+	MUX_ERR_UNKNOWN_SOURCE, // the subpeer a data packet claims to come from isn't known
+	MUX_ERR_UNAUTHORIZED, // the packet claims a subpeer that doesn't belong to its sender
+	MUX_ERR_INVALID, // well formed but not allowed
+	MUX_ERR_TRANSPORT, // the transport failed to send
+	MUX_ERR_UNAVAILABLE, // can't be used right now, expected now and then, e.g. a delta whose baseline was lost
+	MUX_ERR_REFUSED, // a command the network turned down, e.g. ADD_PEER for an id that is taken
+	MUX_ERR_BUSY // the sender is over its ingress budget
+};
+
+enum MultiplexPacketSubtype : uint8_t {
+	MUX_DATA = 0x00,
+	MUX_CMD = 0x01,
+	MUX_DATA_DELTA = 0x02, // MUX_DATA whose payload is encoded against an earlier payload of the same stream, see MuxDeltaCodec
+	MUX_DATA_SEQUENCED = 0x03 // MUX_DATA with a per stream sequence number, sent for TRANSFER_MODE_UNRELIABLE_ORDERED
+};
+
+enum MultiplexPacketCommandSubtype : uint8_t {
+	MUX_CMD_ADD_PEER = 0x00, // Sent from client->server to request a new peer, from server->client to inform old peers of new peers
+	MUX_CMD_ADD_PEER_ACK = 0x01, // Sent in response to ADD_PEER, from server->client informing user that peer was created successfully
+	MUX_CMD_ERR_SUBPEERS_EXCEEDED = 0x02, // Sent in response to ADD_PEER, from server->client, when adding a peer is rejected.
+	MUX_CMD_ERR_SUBPEER_ID_EXISTS = 0x03, // Sent in response to ADD_PEER, from server->client, when adding a peer is rejected.
+	MUX_CMD_REMOVE_PEER = 0x04, // Sent from server<->client to inform peer has left, always forced either direction, not necessarily sent on leave
+	MUX_CMD_RESUME_TOKEN = 0x05, // Sent from server->client once per host peer when resume is enabled, carries the token to resume with
+	MUX_CMD_RESUME = 0x06, // Sent from client->server after reconnecting, carries the token, reclaims the subpeers of the old host peer
+	MUX_CMD_RESUME_ACK = 0x07, // Sent in response to RESUME, from server->client, the subpeers are connected again under the same ids
+	MUX_CMD_ERR_RESUME_REJECTED = 0x08, // Sent in response to RESUME, from server->client, when the token is unknown or has expired
+	MUX_CMD_DELTA_ACK = 0x09, // Sent from the receiver of a delta stream to its sender, subject is the stream's source, the sequence may be used as a baseline
+};
+
+// Commands are from MultiplexNetwork to MultiplexNetwork, routed through MultiplayerPeer
+// i.e. MuxNet -> SteamMultiplayerPeer -> Steam Relay -> SteamMultiplayerPeer -> MuxNet
+// These should not find themeselves in a MultiplexPeer
+struct MultiplexPacketCommand {
+	MultiplexPacketCommandSubtype subtype;
+	int32_t subject_multiplex_peer;
+	// only serialized for MUX_CMD_DELTA_ACK
+	int32_t stream_dest;
+	int32_t stream_channel;
+	uint16_t stream_sequence;
+	// only serialized for MUX_CMD_RESUME_TOKEN and MUX_CMD_RESUME
+	uint64_t resume_token;
+};
+
+// Data are from MultiplexPeer to MultiplexPeer, routed through Multiplex Network
+// i.e. MuxPeer -> MuxNet -> SteamMultiplayerPeer -> Steam Relay -> SteamMultiplayerPeer -> MuxNet -> MuxPeer
+// The bytes themselves follow the header, a dest <= 0 is a broadcast (excluding -dest)
+struct MultiplexPacketData {
+	uint32_t length;
+	int32_t mux_peer_source;
+	int32_t mux_peer_dest;
+	// sequence is serialized for MUX_DATA_SEQUENCED and MUX_DATA_DELTA, it counts the packets of one stream
+	// the rest only for MUX_DATA_DELTA, length is then the length of the encoded payload
+	uint16_t sequence;
+	uint16_t baseline; // equal to sequence for a keyframe
+	uint32_t decoded_length;
+};
+
+/*
+ * serializes to
+ *  0-0               uint8_t subtype = 0x00
+ *  1-1               uint8_t transfer_mode
+ *  2-3               uint16_t session;
+ *  4-7               uint32_t length;
+ *  8-11              int32_t mux_peer_source;
+ *  12-15             int32_t mux_peer_dest;
+ *  16-16+(len*8 - 1) uint8_t[length] data;
+ *
+ * size is 16 + length
+ *
+ * OR
+ *
+ *  0-0 uint8_t subtype = 0x01
+ *  1-1 uint8_t transfer_mode
+ *  2-3 uint16_t session
+ *  4-4 uint8_t command_subtype
+ *  5-8 int32_t subject_multiplex_peer;
+ *  size is 9
+ *
+ *  MUX_DATA_DELTA (0x02) is laid out as MUX_DATA, followed by
+ *  16-17             uint16_t sequence;
+ *  18-19             uint16_t baseline;
+ *  20-23             uint32_t decoded_length;
+ *  24-24+(len*8 - 1) uint8_t[length] encoded data;
+ *  size is 24 + length
+ *
+ *  MUX_DATA_SEQUENCED (0x03) is laid out as MUX_DATA, followed by
+ *  16-17             uint16_t sequence;
+ *  18-18+(len*8 - 1) uint8_t[length] data;
+ *  size is 18 + length
+ *
+ *  MUX_CMD_DELTA_ACK is laid out as any other command, followed by
+ *  9-12  int32_t stream_dest;
+ *  13-16 int32_t stream_channel;
+ *  17-18 uint16_t stream_sequence;
+ *  size is 19
+ *
+ *  MUX_CMD_RESUME_TOKEN and MUX_CMD_RESUME are laid out as any other command, followed by
+ *  9-16  uint64_t resume_token;
+ *  size is 17
+ *
+ *  session is shared by every packet type at the same offset, so a MultiplexDemux can route a
+ *  packet to its MultiplexNetwork without deserializing it.
+ *
+ *  Integers are little endian, the same as PackedByteArray::encode_*.
+ */
+
+// true if sequence was sent after last, works across wraparound as long as they are less than 32768 apart
+static inline bool mux_sequence_is_newer(uint16_t sequence, uint16_t last) {
+	return (int16_t)(uint16_t)(sequence - last) > 0;
+}
+
+bool mux_is_data_subtype(uint8_t subtype);
+bool mux_is_valid_command_subtype(uint8_t command_subtype);
+uint32_t mux_get_command_size(uint8_t command_subtype);
+// checks that a serialized packet is well formed, everything received from a host peer goes through this first
+MuxError mux_validate(const uint8_t *data, uint32_t size);
+// reads only the session id, used to pick which network gets the packet
+MuxError mux_peek_session(const uint8_t *data, uint32_t size, uint16_t &r_session);
+// reads the header of a validated data, sequenced or delta packet without touching its payload
+MuxError mux_peek_data_header(const uint8_t *data, uint32_t size, uint8_t &r_transfer_mode, int32_t &r_source, int32_t &r_dest);
+// reads the sequence of a validated sequenced or delta packet, MUX_ERR_PARSE for any other packet
+MuxError mux_peek_sequence(const uint8_t *data, uint32_t size, uint16_t &r_sequence);
+// header size of a data, sequenced or delta packet, the payload goes right after it
+uint32_t mux_get_data_header_size(uint8_t subtype);
+// out must hold mux_get_data_header_size(subtype) bytes, returns the bytes written
+uint32_t mux_write_data_header(uint8_t *out, uint8_t subtype, uint8_t transfer_mode, uint16_t session, const MultiplexPacketData &data);
+// reads the header of a validated data, sequenced or delta packet
+MuxError mux_read_data_header(const uint8_t *data, uint32_t size, MultiplexPacketData &r_data);
+// out must hold mux_get_command_size(command.subtype) bytes, returns the bytes written
+uint32_t mux_write_command(uint8_t *out, uint8_t transfer_mode, uint16_t session, const MultiplexPacketCommand &command);
+MuxError mux_read_command(const uint8_t *data, uint32_t size, MultiplexPacketCommand &r_command);
+#endif
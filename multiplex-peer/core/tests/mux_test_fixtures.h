@@ -0,0 +1,169 @@
+#ifndef MUX_TEST_FIXTURES_H
+#define MUX_TEST_FIXTURES_H
+#include "../mux_router.h"
+#include "../mux_session.h"
+#include "../mux_table.h"
+#include "../mux_transport.h"
+#include <cstdint>
+#include <cstring>
+
+// Stand ins for what the core gets from its embedder, shared by the core tests and the fuzzer
+
+// Local subpeer 1, subpeers 2 and 3 of host peer 10, 4 of host peer 11 and 5 whose host peer is away
+class MuxTestDirectory : public MuxDirectory {
+public:
+	bool has_local_subpeer(int32_t subpeer) const override {
+		return subpeer == 1;
+	}
+	bool get_subpeer_owner(int32_t subpeer, int32_t &r_host_peer) const override {
+		switch (subpeer) {
+			case 2:
+			case 3:
+				r_host_peer = 10;
+				return true;
+			case 4:
+				r_host_peer = 11;
+				return true;
+			case 5:
+				r_host_peer = MUX_HOST_PEER_AWAY;
+				return true;
+			default:
+				return false;
+		}
+	}
+};
+
+// Keeps every packet put to it, one per target
+class MuxTestTransport : public MuxTransport {
+public:
+	struct Sent {
+		int32_t target = 0;
+		int32_t channel = 0;
+		MuxTransferMode transfer_mode = MUX_TRANSFER_MODE_RELIABLE;
+		MuxArray<uint8_t> data;
+	};
+	int32_t unique_id = 1;
+	bool connected = true;
+	MuxArray<Sent> sent;
+	int32_t get_unique_id() const override {
+		return unique_id;
+	}
+	bool is_server() const override {
+		return unique_id == 1;
+	}
+	bool is_connected() const override {
+		return connected;
+	}
+	MuxError put_packet(const int32_t *targets, uint32_t count, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *header, uint32_t header_size, const uint8_t *payload, uint32_t payload_size) override {
+		for (uint32_t i = 0; i < count; i++) {
+			Sent packet;
+			packet.target = targets[i];
+			packet.channel = channel;
+			packet.transfer_mode = transfer_mode;
+			packet.data.resize(header_size + payload_size);
+			memcpy(packet.data.ptr(), header, header_size);
+			if (payload_size != 0) {
+				memcpy(packet.data.ptr() + header_size, payload, payload_size);
+			}
+			sent.push_back(packet);
+		}
+		return MUX_OK;
+	}
+	// the command of the index-th packet sent, subtype 0xFF if it isn't one
+	MultiplexPacketCommand command_at(uint32_t index) const {
+		MultiplexPacketCommand command;
+		memset(&command, 0, sizeof(command));
+		command.subtype = (MultiplexPacketCommandSubtype)0xFF;
+		if (index < sent.size()) {
+			mux_read_command(sent[index].data.ptr(), sent[index].data.size(), command);
+		}
+		return command;
+	}
+	bool has_sent_command(MultiplexPacketCommandSubtype subtype, int32_t subject, int32_t target) const {
+		for (uint32_t i = 0; i < sent.size(); i++) {
+			MultiplexPacketCommand command = command_at(i);
+			if (command.subtype == subtype && command.subject_multiplex_peer == subject && sent[i].target == target) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+// Keeps everything a session tells its listener
+class MuxTestListener : public MuxSessionListener {
+public:
+	enum EventKind {
+		CONNECTED, // peer_connected(subpeer) on to_subpeer
+		DISCONNECTED, // peer_disconnected(subpeer) on to_subpeer
+		LOCAL_CONNECTED,
+		LOCAL_CLOSED
+	};
+	struct Event {
+		EventKind kind = CONNECTED;
+		int32_t to_subpeer = 0;
+		int32_t subpeer = 0;
+		bool operator==(const Event &other) const {
+			return kind == other.kind && to_subpeer == other.to_subpeer && subpeer == other.subpeer;
+		}
+	};
+	struct Delivery {
+		int32_t source = 0;
+		int32_t dest = 0;
+		int32_t channel = 0;
+		MuxArray<uint8_t> payload;
+	};
+	uint64_t now_msec = 0;
+	uint64_t next_random = 0x9E3779B97F4A7C15ull;
+	MuxArray<Event> events;
+	MuxArray<Delivery> deliveries;
+	void record(EventKind kind, int32_t to_subpeer, int32_t subpeer) {
+		Event event;
+		event.kind = kind;
+		event.to_subpeer = to_subpeer;
+		event.subpeer = subpeer;
+		events.push_back(event);
+	}
+	bool has(EventKind kind, int32_t to_subpeer, int32_t subpeer) const {
+		Event event;
+		event.kind = kind;
+		event.to_subpeer = to_subpeer;
+		event.subpeer = subpeer;
+		return events.has(event);
+	}
+	void subpeer_connected(int32_t to_subpeer, int32_t subpeer) override {
+		record(CONNECTED, to_subpeer, subpeer);
+	}
+	void subpeer_disconnected(int32_t to_subpeer, int32_t subpeer) override {
+		record(DISCONNECTED, to_subpeer, subpeer);
+	}
+	void local_subpeer_connected(int32_t subpeer) override {
+		record(LOCAL_CONNECTED, subpeer, subpeer);
+	}
+	void local_subpeer_closed(int32_t subpeer) override {
+		record(LOCAL_CLOSED, subpeer, subpeer);
+	}
+	void deliver(int32_t source, int32_t dest, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *payload, uint32_t length) override {
+		(void)transfer_mode;
+		Delivery delivery;
+		delivery.source = source;
+		delivery.dest = dest;
+		delivery.channel = channel;
+		delivery.payload.resize(length);
+		if (length != 0) {
+			memcpy(delivery.payload.ptr(), payload, length);
+		}
+		deliveries.push_back(delivery);
+	}
+	uint64_t get_ticks_msec() override {
+		return now_msec;
+	}
+	uint64_t generate_random_u64() override {
+		// splitmix64, tests want the same tokens every run
+		uint64_t z = (next_random += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+};
+#endif
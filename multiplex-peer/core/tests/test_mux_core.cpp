@@ -0,0 +1,657 @@
+#include "../mux_delta.h"
+#include "../mux_delta_runs.h"
+#include "../mux_demux.h"
+#include "../mux_router.h"
+#include "../mux_sequence.h"
+#include "../mux_session.h"
+#include "../mux_transport.h"
+#include "../mux_wire.h"
+#include "mux_test_fixtures.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Tests for the Godot independent core, run with `scons core_tests`.
+// Prints every failed check and exits with the number of failures.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int failures = 0;
+
+#define CHECK(condition)                                                  \
+	do {                                                                  \
+		if (!(condition)) {                                               \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			failures++;                                                   \
+		}                                                                 \
+	} while (0)
+
+// Remembers up to 8 streams
+class TestHistory : public MuxSequenceHistory {
+public:
+	MuxStreamKey keys[8];
+	uint16_t newest[8];
+	int count = 0;
+	uint16_t *get_newest(const MuxStreamKey &key) override {
+		for (int i = 0; i < count; i++) {
+			if (keys[i] == key) {
+				return &newest[i];
+			}
+		}
+		return nullptr;
+	}
+	void insert_newest(const MuxStreamKey &key, uint16_t sequence) override {
+		if (count < 8) {
+			keys[count] = key;
+			newest[count] = sequence;
+			count++;
+		}
+	}
+};
+
+// writes a packet with a payload of length bytes into out, returns its size
+static uint32_t write_data(uint8_t *out, uint8_t subtype, uint8_t transfer_mode, int32_t source, int32_t dest, uint32_t length, uint16_t sequence = 0) {
+	MultiplexPacketData data;
+	memset(&data, 0, sizeof(data));
+	data.length = length;
+	data.mux_peer_source = source;
+	data.mux_peer_dest = dest;
+	data.sequence = sequence;
+	data.baseline = sequence;
+	data.decoded_length = length;
+	uint32_t header_size = mux_write_data_header(out, subtype, transfer_mode, 7, data);
+	for (uint32_t i = 0; i < length; i++) {
+		out[header_size + i] = (uint8_t)i;
+	}
+	return header_size + length;
+}
+
+static void test_data_header() {
+	uint8_t packet[64];
+	uint32_t size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4, 0xBEEF);
+	CHECK(size == MULTIPLEX_SEQUENCED_HEADER_SIZE + 4);
+	CHECK(mux_validate(packet, size) == MUX_OK);
+	uint16_t session = 0;
+	CHECK(mux_peek_session(packet, size, session) == MUX_OK && session == 7);
+	MultiplexPacketData data;
+	CHECK(mux_read_data_header(packet, size, data) == MUX_OK);
+	CHECK(data.length == 4 && data.mux_peer_source == 2 && data.mux_peer_dest == 1 && data.sequence == 0xBEEF);
+	// little endian, right after the MUX_DATA header
+	CHECK(packet[16] == 0xEF && packet[17] == 0xBE);
+	// the payload length has to match the packet size
+	CHECK(mux_validate(packet, size - 1) == MUX_ERR_PARSE);
+	CHECK(mux_validate(packet, 1) == MUX_ERR_PARSE);
+	packet[0] = 0x04;
+	CHECK(mux_validate(packet, size) == MUX_ERR_PARSE);
+}
+
+static void test_peek_sequence() {
+	uint8_t packet[64];
+	uint16_t sequence = 0;
+	uint32_t size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 0, 65535);
+	CHECK(mux_peek_sequence(packet, size, sequence) == MUX_OK && sequence == 65535);
+	size = write_data(packet, MUX_DATA_DELTA, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 0, 300);
+	CHECK(mux_peek_sequence(packet, size, sequence) == MUX_OK && sequence == 300);
+	// plain data has no sequence, the payload must not be read as one
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4);
+	CHECK(mux_peek_sequence(packet, size, sequence) == MUX_ERR_PARSE);
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 0, 1);
+	CHECK(mux_peek_sequence(packet, size - 1, sequence) == MUX_ERR_PARSE);
+}
+
+static void test_sequence_is_newer() {
+	CHECK(mux_sequence_is_newer(1, 0));
+	CHECK(!mux_sequence_is_newer(0, 0));
+	CHECK(!mux_sequence_is_newer(0, 1));
+	// across wraparound
+	CHECK(mux_sequence_is_newer(0, 65535));
+	CHECK(mux_sequence_is_newer(5, 65530));
+	CHECK(!mux_sequence_is_newer(65530, 5));
+	CHECK(mux_sequence_is_newer(32767, 0));
+	CHECK(!mux_sequence_is_newer(32768, 0));
+}
+
+static void test_commands() {
+	uint8_t packet[MULTIPLEX_CMD_MAX_SIZE];
+	MultiplexPacketCommand command;
+	memset(&command, 0, sizeof(command));
+	command.subtype = MUX_CMD_DELTA_ACK;
+	command.subject_multiplex_peer = 2;
+	command.stream_dest = 4;
+	command.stream_channel = 3;
+	command.stream_sequence = 300;
+	uint32_t size = mux_write_command(packet, MUX_TRANSFER_MODE_RELIABLE, 7, command);
+	CHECK(size == MULTIPLEX_CMD_DELTA_ACK_SIZE);
+	CHECK(mux_validate(packet, size) == MUX_OK);
+	MultiplexPacketCommand read;
+	CHECK(mux_read_command(packet, size, read) == MUX_OK);
+	CHECK(read.subtype == MUX_CMD_DELTA_ACK && read.subject_multiplex_peer == 2 && read.stream_dest == 4 && read.stream_channel == 3 && read.stream_sequence == 300);
+	command.subtype = MUX_CMD_RESUME;
+	command.resume_token = 0x0123456789ABCDEFull;
+	size = mux_write_command(packet, MUX_TRANSFER_MODE_RELIABLE, 7, command);
+	CHECK(size == MULTIPLEX_CMD_RESUME_SIZE);
+	CHECK(mux_read_command(packet, size, read) == MUX_OK && read.resume_token == 0x0123456789ABCDEFull);
+	// every command has exactly one size
+	CHECK(mux_validate(packet, MULTIPLEX_CMD_SIZE) == MUX_ERR_PARSE);
+	packet[4] = 0x0A;
+	CHECK(mux_validate(packet, MULTIPLEX_CMD_SIZE) == MUX_ERR_PARSE);
+}
+
+static void test_put_command() {
+	MuxTestTransport transport;
+	MultiplexPacketCommand command;
+	memset(&command, 0, sizeof(command));
+	command.subtype = MUX_CMD_ADD_PEER_ACK;
+	command.subject_multiplex_peer = 3;
+	CHECK(mux_put_command(transport, 10, 7, MUX_TRANSFER_MODE_RELIABLE, command) == MUX_OK);
+	CHECK(transport.sent.size() == 1);
+	CHECK(transport.sent[0].target == 10 && transport.sent[0].channel == 1 && transport.sent[0].data.size() == MULTIPLEX_CMD_SIZE);
+	MultiplexPacketCommand read = transport.command_at(0);
+	CHECK(read.subtype == MUX_CMD_ADD_PEER_ACK && read.subject_multiplex_peer == 3);
+}
+
+static void test_route() {
+	MuxTestDirectory directory;
+	MuxRoute route;
+	uint8_t packet[64];
+	// to a local subpeer
+	uint32_t size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 1, 4);
+	CHECK(mux_route_data(packet, size, 10, false, directory, route) == MUX_OK && route.action == MUX_ROUTE_DELIVER);
+	CHECK(route.source == 2 && route.dest == 1 && route.transfer_mode == MUX_TRANSFER_MODE_RELIABLE);
+	// the source has to belong to the sender, and has to be known at all
+	CHECK(mux_route_data(packet, size, 11, false, directory, route) == MUX_ERR_UNAUTHORIZED);
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 9, 1, 4);
+	CHECK(mux_route_data(packet, size, 10, false, directory, route) == MUX_ERR_UNKNOWN_SOURCE);
+	// to a subpeer of another host peer, only with forwarding
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 4, 4);
+	CHECK(mux_route_data(packet, size, 10, false, directory, route) == MUX_ERR_UNKNOWN_SUBPEER);
+	CHECK(mux_route_data(packet, size, 10, true, directory, route) == MUX_OK && route.action == MUX_ROUTE_FORWARD && route.host_peer == 11);
+	// back to the sender's own host peer
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 3, 4);
+	CHECK(mux_route_data(packet, size, 10, true, directory, route) == MUX_ERR_INVALID);
+	// to a subpeer whose host peer is away
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 5, 4);
+	CHECK(mux_route_data(packet, size, 10, true, directory, route) == MUX_OK && route.action == MUX_ROUTE_DROP);
+	// broadcasts
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 0, 4);
+	CHECK(mux_route_data(packet, size, 10, false, directory, route) == MUX_OK && route.action == MUX_ROUTE_DELIVER);
+	CHECK(mux_route_data(packet, size, 10, true, directory, route) == MUX_OK && route.action == MUX_ROUTE_FORWARD_AND_DELIVER);
+	size = write_data(packet, MUX_DATA_DELTA, MUX_TRANSFER_MODE_UNRELIABLE, 2, 0, 4);
+	CHECK(mux_route_data(packet, size, 10, true, directory, route) == MUX_ERR_PARSE);
+	// sequenced packets are routed by the same header
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 4, 4, 9);
+	CHECK(mux_route_data(packet, size, 10, true, directory, route) == MUX_OK && route.action == MUX_ROUTE_FORWARD && route.host_peer == 11);
+	CHECK(mux_route_data(packet, size, 11, true, directory, route) == MUX_ERR_UNAUTHORIZED);
+}
+
+static void test_sequence_accept() {
+	TestHistory history;
+	MuxStreamKey stream = { 2, 1, 0 };
+	MuxStreamKey other = { 2, 1, 1 };
+	CHECK(mux_sequence_accept(history, stream, 65530));
+	CHECK(!mux_sequence_accept(history, stream, 65529));
+	CHECK(!mux_sequence_accept(history, stream, 65530));
+	// across wraparound
+	CHECK(mux_sequence_accept(history, stream, 3));
+	CHECK(!mux_sequence_accept(history, stream, 65535));
+	CHECK(mux_sequence_accept(history, stream, 4));
+	// every stream is on its own
+	CHECK(mux_sequence_accept(history, other, 0));
+	CHECK(history.count == 2);
+}
+
+// The receive path of a network: route by the header, then drop stale packets before delivering them
+static bool receive(MuxSequenceHistory &history, const uint8_t *data, uint32_t size, int32_t sender_host_peer, int32_t channel, MuxRoute &r_route) {
+	static const MuxTestDirectory directory;
+	if (mux_route_data(data, size, sender_host_peer, true, directory, r_route) != MUX_OK) {
+		return false;
+	}
+	if (r_route.action != MUX_ROUTE_DELIVER && r_route.action != MUX_ROUTE_FORWARD_AND_DELIVER) {
+		return false;
+	}
+	return mux_accept_delivery(history, data, size, r_route, channel);
+}
+
+static void test_receive_path() {
+	TestHistory history;
+	MuxRoute route;
+	uint8_t packet[64];
+	uint32_t size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4, 10);
+	CHECK(receive(history, packet, size, 10, 0, route));
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4, 12);
+	CHECK(receive(history, packet, size, 10, 0, route));
+	// arrived after 12, stale
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4, 11);
+	CHECK(!receive(history, packet, size, 10, 0, route));
+	// the same sequence on another channel is another stream
+	CHECK(receive(history, packet, size, 10, 1, route));
+	// a spoofed source is rejected before its sequence can advance the stream
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4, 200);
+	CHECK(!receive(history, packet, size, 11, 0, route));
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4, 13);
+	CHECK(receive(history, packet, size, 10, 0, route));
+	// broadcasts are sequenced per source as well
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 4, 0, 4, 7);
+	CHECK(receive(history, packet, size, 11, 0, route) && route.action == MUX_ROUTE_FORWARD_AND_DELIVER);
+	size = write_data(packet, MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 4, 0, 4, 6);
+	CHECK(!receive(history, packet, size, 11, 0, route));
+	// other transfer modes and unsequenced packets are never dropped
+	int streams = history.count;
+	size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 1, 4);
+	CHECK(receive(history, packet, size, 10, 0, route));
+	size = write_data(packet, MUX_DATA_DELTA, MUX_TRANSFER_MODE_UNRELIABLE, 2, 1, 4, 1);
+	CHECK(receive(history, packet, size, 10, 0, route));
+	CHECK(receive(history, packet, size, 10, 0, route));
+	CHECK(history.count == streams);
+}
+
+static void test_delta_runs() {
+	uint8_t baseline[32];
+	uint8_t payload[40];
+	for (uint32_t i = 0; i < 32; i++) {
+		baseline[i] = (uint8_t)(i * 7);
+		payload[i] = baseline[i];
+	}
+	// past the end of the baseline a payload is encoded against zeros
+	memset(payload + 32, 0, 8);
+	payload[3] ^= 0x55;
+	payload[20] ^= 0x01;
+	payload[36] = 9;
+	uint8_t encoded[64];
+	uint8_t decoded[40];
+	uint32_t written = 0;
+	CHECK(mux_delta_encode_runs(payload, 40, baseline, 32, encoded, written));
+	CHECK(written < 40);
+	CHECK(mux_delta_decode_runs(encoded, written, baseline, 32, decoded, 40) && memcmp(decoded, payload, 40) == 0);
+	// shorter than the baseline
+	uint32_t short_written = 0;
+	CHECK(mux_delta_encode_runs(payload, 16, baseline, 32, encoded + 32, short_written));
+	CHECK(mux_delta_decode_runs(encoded + 32, short_written, baseline, 32, decoded, 16) && memcmp(decoded, payload, 16) == 0);
+	// nothing in common, a keyframe is smaller
+	uint8_t unrelated[32];
+	for (uint32_t i = 0; i < 32; i++) {
+		unrelated[i] = (uint8_t)~baseline[i];
+	}
+	uint32_t unused = 0;
+	CHECK(!mux_delta_encode_runs(unrelated, 32, baseline, 32, encoded + 32, unused));
+
+	// malformed input is rejected, never read or written out of bounds
+	CHECK(!mux_delta_decode_runs(encoded, written - 1, baseline, 32, decoded, 40));
+	encoded[written] = 0;
+	CHECK(!mux_delta_decode_runs(encoded, written + 1, baseline, 32, decoded, 40));
+	CHECK(!mux_delta_decode_runs(encoded, written, baseline, 32, decoded, 39));
+	const uint8_t zeros_past_end[2] = { 41, 0 };
+	CHECK(!mux_delta_decode_runs(zeros_past_end, 2, baseline, 32, decoded, 40));
+	const uint8_t literals_past_end[3] = { 39, 2, 1 };
+	CHECK(!mux_delta_decode_runs(literals_past_end, 3, baseline, 32, decoded, 40));
+	const uint8_t literals_past_input[3] = { 0, 3, 1 };
+	CHECK(!mux_delta_decode_runs(literals_past_input, 3, baseline, 32, decoded, 40));
+	const uint8_t overlong_varint[6] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+	CHECK(!mux_delta_decode_runs(overlong_varint, 6, baseline, 32, decoded, 40));
+	const uint8_t wrapping_varint[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x01 };
+	CHECK(!mux_delta_decode_runs(wrapping_varint, 6, baseline, 32, decoded, 40));
+	// empty runs don't make progress, they must not loop forever
+	const uint8_t empty_runs[4] = { 0, 0, 0, 0 };
+	CHECK(!mux_delta_decode_runs(empty_runs, 4, baseline, 32, decoded, 1));
+	CHECK(!mux_delta_decode_runs(encoded, 0, baseline, 32, decoded, 40));
+	CHECK(mux_delta_decode_runs(encoded, 0, baseline, 32, decoded, 0));
+}
+
+static void test_delta_codec() {
+	MuxDeltaCodec sender;
+	MuxDeltaCodec receiver;
+	MuxStreamKey key = { 2, 1, 0 };
+	uint8_t payload[64];
+	for (uint32_t i = 0; i < 64; i++) {
+		payload[i] = (uint8_t)i;
+	}
+	uint16_t baseline;
+	const uint8_t *body;
+	uint32_t body_length;
+	const uint8_t *decoded;
+	bool acknowledge = false;
+	// nothing acknowledged yet, a keyframe
+	sender.encode(key, payload, 64, 0, baseline, body, body_length);
+	CHECK(baseline == 0 && body == payload && body_length == 64);
+	CHECK(receiver.decode(key, 0, 0, 64, body, body_length, decoded, acknowledge) == MUX_OK && acknowledge);
+	CHECK(memcmp(decoded, payload, 64) == 0);
+	sender.acknowledge(key, 0);
+	payload[5] ^= 1;
+	sender.encode(key, payload, 64, 1, baseline, body, body_length);
+	CHECK(baseline == 0 && body_length < 64);
+	uint8_t delta[64];
+	uint32_t delta_length = body_length;
+	memcpy(delta, body, body_length);
+	CHECK(receiver.decode(key, 1, 0, 64, delta, delta_length, decoded, acknowledge) == MUX_OK && !acknowledge);
+	CHECK(memcmp(decoded, payload, 64) == 0);
+	// an ack for a sequence that was never sent doesn't move the baseline
+	sender.acknowledge(key, 40);
+	sender.encode(key, payload, 64, 2, baseline, body, body_length);
+	CHECK(baseline == 0);
+	// without its baseline a delta is dropped until the next keyframe
+	MuxDeltaCodec fresh;
+	CHECK(fresh.decode(key, 1, 0, 64, delta, delta_length, decoded, acknowledge) == MUX_ERR_UNAVAILABLE);
+	// a malformed delta leaves the history as it was
+	CHECK(receiver.decode(key, 3, 0, 64, delta, delta_length - 1, decoded, acknowledge) == MUX_ERR_PARSE);
+	CHECK(receiver.decode(key, 4, 0, 64, delta, delta_length, decoded, acknowledge) == MUX_OK);
+	CHECK(memcmp(decoded, payload, 64) == 0);
+	// a keyframe has to be as long as it says
+	CHECK(receiver.decode(key, 5, 5, 64, payload, 63, decoded, acknowledge) == MUX_ERR_PARSE);
+	// streams of a subpeer that left start over with a keyframe
+	sender.forget(1);
+	sender.encode(key, payload, 64, 6, baseline, body, body_length);
+	CHECK(baseline == 6 && body == payload);
+}
+
+// A server session on host peer 1 and a client session on host peer 10, and the connection between them
+class TestPair {
+public:
+	MuxTestTransport server_transport;
+	MuxTestTransport client_transport;
+	MuxTestListener server_events;
+	MuxTestListener client_events;
+	MuxSession server;
+	MuxSession client;
+	uint32_t server_read = 0;
+	uint32_t client_read = 0;
+	int errors = 0; // rejected packets on either side
+	TestPair() :
+			server(server_events), client(client_events) {
+		client_transport.unique_id = 10;
+		client_transport.connected = false;
+		server.attach(&server_transport);
+		client.attach(&client_transport);
+		server.add_local_subpeer(1);
+	}
+	// hands every packet put to the other side over until neither side has anything left to send
+	void pump() {
+		bool moved = true;
+		while (moved) {
+			moved = false;
+			while (client_read < client_transport.sent.size()) {
+				// a copy, receiving may put more packets
+				MuxTestTransport::Sent packet = client_transport.sent[client_read++];
+				moved = true;
+				if (packet.target == 1 && server.receive(client_transport.unique_id, packet.channel, packet.data.ptr(), packet.data.size()) != MUX_OK) {
+					errors++;
+				}
+			}
+			while (server_read < server_transport.sent.size()) {
+				MuxTestTransport::Sent packet = server_transport.sent[server_read++];
+				moved = true;
+				if (packet.target == client_transport.unique_id && client.receive(1, packet.channel, packet.data.ptr(), packet.data.size()) != MUX_OK) {
+					errors++;
+				}
+			}
+		}
+	}
+	void connect() {
+		client_transport.connected = true;
+		server.host_peer_connected(client_transport.unique_id);
+		client.host_peer_connected(1);
+		pump();
+	}
+	// both sides see the connection drop, the client comes back as host_peer
+	void disconnect() {
+		client_transport.connected = false;
+		client.host_peer_disconnected(1);
+		server.host_peer_disconnected(client_transport.unique_id);
+		pump();
+	}
+};
+
+static void test_session_handshake() {
+	TestPair pair;
+	CHECK(pair.client.add_local_subpeer(2) == MUX_OK);
+	CHECK(pair.client.add_local_subpeer(2) == MUX_ERR_INVALID);
+	CHECK(pair.client_transport.sent.is_empty());
+	pair.connect();
+	CHECK(pair.errors == 0);
+	CHECK(pair.client_events.has(MuxTestListener::LOCAL_CONNECTED, 2, 2));
+	CHECK(pair.client_events.has(MuxTestListener::CONNECTED, 2, 1));
+	CHECK(pair.server_events.has(MuxTestListener::CONNECTED, 1, 2));
+	CHECK(pair.server.get_subpeer_host_peer(2) == 10 && pair.client.get_subpeer_host_peer(2) == 10);
+	// a late subpeer asks for itself
+	CHECK(pair.client.add_local_subpeer(3) == MUX_OK);
+	pair.pump();
+	CHECK(pair.server_events.has(MuxTestListener::CONNECTED, 1, 3));
+	// taken ids are refused, the client drops its subpeer
+	CHECK(pair.server.add_local_subpeer(4) == MUX_OK);
+	CHECK(pair.client.add_local_subpeer(4) == MUX_OK);
+	pair.pump();
+	CHECK(pair.errors == 1);
+	CHECK(!pair.client.has_local_subpeer(4) && pair.client_events.has(MuxTestListener::LOCAL_CLOSED, 4, 4));
+
+	const uint8_t payload[5] = { 1, 2, 3, 4, 5 };
+	CHECK(pair.client.send(2, 1, 0, MUX_TRANSFER_MODE_RELIABLE, payload, 5) == MUX_OK);
+	CHECK(pair.server.send(1, 3, 2, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, payload, 3) == MUX_OK);
+	pair.pump();
+	CHECK(pair.server_events.deliveries.size() == 1 && pair.client_events.deliveries.size() == 1);
+	const MuxTestListener::Delivery &to_server = pair.server_events.deliveries[0];
+	CHECK(to_server.source == 2 && to_server.dest == 1 && to_server.payload.size() == 5 && memcmp(to_server.payload.ptr(), payload, 5) == 0);
+	const MuxTestListener::Delivery &to_client = pair.client_events.deliveries[0];
+	CHECK(to_client.source == 1 && to_client.dest == 3 && to_client.channel == 2 && to_client.payload.size() == 3);
+	CHECK(pair.client.send(2, 9, 0, MUX_TRANSFER_MODE_RELIABLE, payload, 5) == MUX_ERR_UNKNOWN_SUBPEER);
+	// the client's subpeers can't be spoofed by another host peer
+	uint8_t packet[64];
+	uint32_t size = write_data(packet, MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 1, 4);
+	CHECK(pair.server.receive(11, 0, packet, size) == MUX_ERR_UNAUTHORIZED);
+	// a subpeer leaving is told to the server
+	pair.client.close_local_subpeer(3);
+	pair.pump();
+	CHECK(!pair.server.has_subpeer(3) && pair.server_events.has(MuxTestListener::DISCONNECTED, 1, 3));
+}
+
+static void test_session_delta() {
+	TestPair pair;
+	pair.server.set_delta_encoding(true);
+	pair.client.set_delta_encoding(true);
+	pair.client.add_local_subpeer(2);
+	pair.connect();
+	uint8_t payload[64];
+	for (uint32_t i = 0; i < 64; i++) {
+		payload[i] = (uint8_t)i;
+	}
+	for (int i = 0; i < 8; i++) {
+		payload[i] ^= 0xFF;
+		CHECK(pair.client.send(2, 1, 0, MUX_TRANSFER_MODE_UNRELIABLE, payload, 64) == MUX_OK);
+		const MuxTestTransport::Sent &sent = pair.client_transport.sent[pair.client_transport.sent.size() - 1];
+		CHECK(sent.data[0] == MUX_DATA_DELTA);
+		// once the keyframe is acknowledged only the changed bytes are sent
+		CHECK(i == 0 || sent.data.size() < MULTIPLEX_DELTA_HEADER_SIZE + 16);
+		pair.pump();
+		CHECK(pair.server_events.deliveries.size() == (uint32_t)i + 1);
+		const MuxTestListener::Delivery &delivery = pair.server_events.deliveries[i];
+		CHECK(delivery.payload.size() == 64 && memcmp(delivery.payload.ptr(), payload, 64) == 0);
+	}
+	CHECK(pair.errors == 0);
+}
+
+static void test_session_server_close() {
+	TestPair pair;
+	pair.client.add_local_subpeer(2);
+	pair.client.add_local_subpeer(3);
+	pair.connect();
+	// subpeer 1 leaving ends the session on both sides, without dropping the host peer
+	pair.server.close_local_subpeer(1);
+	CHECK(pair.server_transport.has_sent_command(MUX_CMD_REMOVE_PEER, 1, 10));
+	CHECK(!pair.server.has_subpeer(2) && pair.server_events.has(MuxTestListener::DISCONNECTED, 1, 2));
+	pair.pump();
+	CHECK(!pair.client.has_local_subpeer(2) && !pair.client.has_local_subpeer(3));
+	CHECK(pair.client_events.has(MuxTestListener::LOCAL_CLOSED, 2, 2) && pair.client_events.has(MuxTestListener::LOCAL_CLOSED, 3, 3));
+	CHECK(pair.client_events.has(MuxTestListener::DISCONNECTED, 2, 1));
+	// nothing is left that could answer
+	pair.client.add_local_subpeer(5);
+	pair.pump();
+	CHECK(pair.errors == 1);
+}
+
+static void test_session_resume() {
+	TestPair pair;
+	pair.server.set_resume_grace_period_msec(1000);
+	pair.client.set_resume_grace_period_msec(1000);
+	pair.client.add_local_subpeer(2);
+	pair.client.add_local_subpeer(3);
+	pair.connect();
+	pair.disconnect();
+	CHECK(pair.client.is_resuming() && pair.client.has_local_subpeer(2));
+	CHECK(pair.server.get_subpeer_host_peer(2) == MUX_HOST_PEER_AWAY);
+	CHECK(!pair.server_events.has(MuxTestListener::DISCONNECTED, 1, 2));
+	// closed and added while the server was away
+	pair.client.close_local_subpeer(3);
+	pair.client.add_local_subpeer(4);
+	CHECK(pair.client.send(2, 1, 0, MUX_TRANSFER_MODE_RELIABLE, nullptr, 0) == MUX_OK);
+	pair.client_transport.unique_id = 12;
+	pair.server_events.now_msec = pair.client_events.now_msec = 500;
+	pair.connect();
+	// the server acknowledges 3 once more before it hears 3 was closed
+	CHECK(pair.errors == 1);
+	CHECK(!pair.client.is_resuming());
+	CHECK(pair.server.get_subpeer_host_peer(2) == 12 && !pair.server.has_subpeer(3) && pair.server.get_subpeer_host_peer(4) == 12);
+	CHECK(pair.server_events.has(MuxTestListener::DISCONNECTED, 1, 3));
+	CHECK(!pair.server_events.has(MuxTestListener::DISCONNECTED, 1, 2));
+	CHECK(pair.client_events.has(MuxTestListener::LOCAL_CONNECTED, 4, 4));
+	// a grace period that runs out removes the subpeers for good
+	pair.disconnect();
+	pair.server_events.now_msec = 1499;
+	pair.server.update();
+	CHECK(pair.server.has_subpeer(2));
+	pair.server_events.now_msec = 1500;
+	pair.server.update();
+	CHECK(!pair.server.has_subpeer(2) && pair.server_events.has(MuxTestListener::DISCONNECTED, 1, 2));
+	// the token is gone with them
+	pair.client_transport.unique_id = 13;
+	pair.connect();
+	CHECK(pair.server_transport.has_sent_command(MUX_CMD_ERR_RESUME_REJECTED, 0, 13));
+	CHECK(!pair.client.has_local_subpeer(2) && pair.client_events.has(MuxTestListener::LOCAL_CLOSED, 2, 2));
+}
+
+// Admits host peers to any session but 9, keeps who it was told to disconnect
+class TestDemuxListener : public MuxDemuxListener {
+public:
+	MuxArray<int32_t> disconnected;
+	bool admit_session(int32_t host_peer, uint16_t session) override {
+		(void)host_peer;
+		return session != 9;
+	}
+	void disconnect_host_peer(int32_t host_peer, uint32_t violations) override {
+		(void)violations;
+		disconnected.push_back(host_peer);
+	}
+};
+
+static uint32_t write_add_peer(uint8_t *out, uint16_t session, int32_t subpeer) {
+	MultiplexPacketCommand command;
+	memset(&command, 0, sizeof(command));
+	command.subtype = MUX_CMD_ADD_PEER;
+	command.subject_multiplex_peer = subpeer;
+	return mux_write_command(out, MUX_TRANSFER_MODE_RELIABLE, session, command);
+}
+
+static void test_demux() {
+	MuxTestTransport transport;
+	TestDemuxListener demux_events;
+	MuxTestListener events;
+	MuxSession session(events);
+	MuxSession other(events);
+	MuxSession refused(events);
+	MuxDemux demux(demux_events);
+	demux.set_transport(&transport);
+	CHECK(demux.add_session(7, &session));
+	CHECK(!demux.add_session(7, &other));
+	CHECK(demux.add_session(8, &other) && demux.add_session(9, &refused));
+	session.add_local_subpeer(1);
+	other.add_local_subpeer(1);
+	refused.add_local_subpeer(1);
+	uint8_t packet[MULTIPLEX_CMD_MAX_SIZE];
+	// two packets a tick, the first one over counts and the rest are dropped quietly
+	demux.set_max_packets_per_tick(2);
+	demux.set_violation_limit(3);
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 2), 1) == MUX_OK);
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 3), 1) == MUX_OK);
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 4), 1) == MUX_ERR_BUSY);
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 4), 1) == MUX_OK);
+	CHECK(session.has_subpeer(3) && !session.has_subpeer(4));
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 4), 2) == MUX_OK && session.has_subpeer(4));
+	// host peer 10 is pinned to session 7
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 8, 5), 2) == MUX_ERR_UNAUTHORIZED);
+	CHECK(demux_events.disconnected.is_empty());
+	demux.set_max_packets_per_tick(0);
+	// every fourth failed command counts, 10 is at three violations
+	for (int i = 0; i < 3; i++) {
+		CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 2), 3) == MUX_ERR_REFUSED);
+	}
+	CHECK(demux_events.disconnected.is_empty());
+	CHECK(demux.receive(10, 1, packet, write_add_peer(packet, 7, 2), 3) == MUX_ERR_REFUSED);
+	CHECK(demux_events.disconnected.size() == 1 && demux_events.disconnected[0] == 10);
+	// unknown sessions are benign, sessions the listener refuses are not
+	CHECK(demux.receive(11, 1, packet, write_add_peer(packet, 6, 5), 3) == MUX_ERR_UNAVAILABLE);
+	CHECK(demux.receive(11, 1, packet, write_add_peer(packet, 9, 5), 3) == MUX_ERR_UNAUTHORIZED);
+	CHECK(demux.receive(11, 1, packet, 3, 3) == MUX_ERR_PARSE);
+	CHECK(demux.receive(11, 1, packet, write_add_peer(packet, 8, 5), 3) == MUX_OK && other.has_subpeer(5));
+	CHECK(demux.receive(11, 1, packet, 3, 3) == MUX_ERR_PARSE);
+	CHECK(demux_events.disconnected.size() == 2 && demux_events.disconnected[1] == 11);
+	// leaving the demux takes a session offline, a disconnect reaches every session
+	demux.host_peer_disconnected(10);
+	CHECK(!session.has_subpeer(2) && other.has_subpeer(5));
+	demux.remove_session(9);
+	CHECK(refused.is_offline() && demux.get_session_count() == 2 && demux.get_session(9) == nullptr);
+}
+
+// Mutates valid packets and runs them through the fuzz entry point, which aborts on a broken invariant
+static void test_fuzz_entry() {
+	uint8_t seeds[5][64];
+	uint32_t sizes[5];
+	sizes[0] = write_data(seeds[0], MUX_DATA, MUX_TRANSFER_MODE_RELIABLE, 2, 4, 8);
+	sizes[1] = write_data(seeds[1], MUX_DATA_SEQUENCED, MUX_TRANSFER_MODE_UNRELIABLE_ORDERED, 2, 0, 8, 3);
+	sizes[2] = write_data(seeds[2], MUX_DATA_DELTA, MUX_TRANSFER_MODE_UNRELIABLE, 4, 1, 8, 3);
+	MultiplexPacketCommand command;
+	memset(&command, 0, sizeof(command));
+	command.subtype = MUX_CMD_RESUME_TOKEN;
+	command.resume_token = 42;
+	sizes[3] = mux_write_command(seeds[3], MUX_TRANSFER_MODE_RELIABLE, 7, command);
+	command.subtype = MUX_CMD_REMOVE_PEER;
+	command.subject_multiplex_peer = 2;
+	sizes[4] = mux_write_command(seeds[4], MUX_TRANSFER_MODE_RELIABLE, 7, command);
+	uint32_t state = 0x12345678;
+	uint8_t packet[64];
+	for (int i = 0; i < 200000; i++) {
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		uint32_t seed = state % 5;
+		uint32_t size = sizes[seed];
+		memcpy(packet, seeds[seed], size);
+		// flip one of the first 24 bytes, where the headers are, and sometimes cut the packet short
+		packet[(state >> 8) % 24] ^= (uint8_t)(1 << ((state >> 16) % 8));
+		if ((state >> 24) % 8 == 0) {
+			size = (state >> 3) % (size + 1);
+		}
+		LLVMFuzzerTestOneInput(packet, size);
+	}
+}
+
+int main() {
+	test_data_header();
+	test_peek_sequence();
+	test_sequence_is_newer();
+	test_commands();
+	test_put_command();
+	test_route();
+	test_sequence_accept();
+	test_receive_path();
+	test_delta_runs();
+	test_delta_codec();
+	test_session_handshake();
+	test_session_delta();
+	test_session_server_close();
+	test_session_resume();
+	test_demux();
+	test_fuzz_entry();
+	if (failures == 0) {
+		printf("core tests passed\n");
+	}
+	return failures;
+}
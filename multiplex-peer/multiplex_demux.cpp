@@ -0,0 +1,215 @@
+#include "multiplex_demux.h"
+#include "godot_cpp/classes/engine.hpp"
+#include "godot_cpp/classes/global_constants.hpp"
+#include "godot_cpp/classes/time.hpp"
+#include "godot_cpp/classes/multiplayer_peer.hpp"
+#include "godot_cpp/core/class_db.hpp"
+#include "godot_cpp/core/error_macros.hpp"
+#include "godot_cpp/variant/callable.hpp"
+#include "godot_cpp/variant/packed_byte_array.hpp"
+#include "multiplex_network.h"
+#include "multiplex_packet.h"
+#include <cstdio>
+
+using namespace godot;
+
+#define REJECTION_REPORT_INTERVAL_MSEC 1000
+
+MultiplexDemux::MultiplexDemux() :
+		listener(this), core(listener) {
+  core.set_transport(&host);
+}
+
+Error MultiplexDemux::set_host_peer(Ref<MultiplayerPeer> host_peer) {
+  ERR_FAIL_COND_V_MSG(host_peer.is_null(), godot::ERR_INVALID_PARAMETER, "host_peer must not be null");
+  if (host.is_valid()) {
+    host.get_peer()->disconnect("peer_connected", Callable(this, "_callback_host_peer_connected"));
+    host.get_peer()->disconnect("peer_disconnected", Callable(this, "_callback_host_peer_disconnected"));
+  }
+  host.set_peer(host_peer);
+  host_peer->connect("peer_connected", Callable(this, "_callback_host_peer_connected"));
+  host_peer->connect("peer_disconnected", Callable(this, "_callback_host_peer_disconnected"));
+  return OK;
+}
+
+Ref<MultiplayerPeer> MultiplexDemux::get_host_peer() {
+  return host.get_peer();
+}
+
+Error MultiplexDemux::add_network(int session_id, Ref<MultiplexNetwork> network) {
+  ERR_FAIL_COND_V_MSG(network.is_null(), godot::ERR_INVALID_PARAMETER, "network must not be null");
+  ERR_FAIL_COND_V_MSG(session_id < 0 || session_id > UINT16_MAX, godot::ERR_PARAMETER_RANGE_ERROR, "session_id must be between 0 and 65535");
+  ERR_FAIL_COND_V_MSG(networks.has(session_id), godot::ERR_ALREADY_EXISTS, "A network is already registered for this session_id");
+  // Attaching starts the network over with no subpeers, so live subpeers are never dropped silently
+  ERR_FAIL_COND_V_MSG(!network->internal_peers.is_empty(), godot::ERR_ALREADY_IN_USE, "A network with subpeers cannot be moved to another demux, close its subpeers first");
+  if (network->demux.is_valid()) {
+    Ref<MultiplexDemux> previous = network->demux;
+    bool same_host_peer = previous.ptr() != this && previous->host.is_valid() && previous->host.get_peer() == host.get_peer();
+    ERR_FAIL_COND_V_MSG(same_host_peer && previous->networks.size() > 1, godot::ERR_ALREADY_IN_USE, "host_peer is already polled by another demux");
+    previous->_detach_network(network.ptr());
+    if (same_host_peer) {
+      // typically the private demux of set_host_peer, it must not close the host peer this demux now polls
+      previous->_release_host_peer();
+    }
+  }
+  printf("MUXNET - DEMUX - adding network for session %d\n", session_id);
+  network->_attach(this);
+  networks.insert(session_id, network.ptr());
+  core.add_session(session_id, &network->session);
+  return OK;
+}
+
+void MultiplexDemux::remove_network(int session_id) {
+  ERR_FAIL_COND_MSG(!networks.has(session_id), "No network is registered for this session_id");
+  MultiplexNetwork *network = networks.get(session_id);
+  networks.erase(session_id);
+  core.remove_session(session_id);
+  network->_detach();
+}
+
+void MultiplexDemux::_detach_network(MultiplexNetwork *network) {
+  for (HashMap<uint16_t, MultiplexNetwork *>::Iterator E = networks.begin(); E; ++E) {
+    if (E->value == network) {
+      core.remove_session(E->key);
+      networks.erase(E->key);
+      return;
+    }
+  }
+}
+
+void MultiplexDemux::_release_host_peer() {
+  if (host.is_valid()) {
+    host.get_peer()->disconnect("peer_connected", Callable(this, "_callback_host_peer_connected"));
+    host.get_peer()->disconnect("peer_disconnected", Callable(this, "_callback_host_peer_disconnected"));
+    host.set_peer(Ref<MultiplayerPeer>());
+  }
+}
+
+bool MultiplexDemux::has_network(int session_id) {
+  return session_id >= 0 && session_id <= UINT16_MAX && networks.has(session_id);
+}
+
+int MultiplexDemux::get_network_count() {
+  return networks.size();
+}
+
+bool MultiplexDemux::is_shared() {
+  return networks.size() > 1;
+}
+
+void MultiplexDemux::_callback_host_peer_connected(int to_host_peer_pid) {
+  // signals fire from inside the host peer's poll, before the adapter would notice the new state
+  host.refresh();
+  printf("MUXNET - DEMUX - host_peer %d connected\n", to_host_peer_pid);
+  core.host_peer_connected(to_host_peer_pid);
+}
+
+void MultiplexDemux::_callback_host_peer_disconnected(int to_host_peer_pid) {
+  host.refresh();
+  printf("MUXNET - DEMUX - host_peer %d disconnected\n", to_host_peer_pid);
+  core.host_peer_disconnected(to_host_peer_pid);
+}
+
+void MultiplexDemux::poll() {
+  host.poll();
+  // poll runs several times per frame, budgets are per frame
+  uint64_t tick = Engine::get_singleton()->get_process_frames();
+  // a packet handler may disconnect a host peer or close the host peer, so the count is re-read every time
+  while (host.get_available_packet_count() > 0) {
+    int32_t sender_host_peer_pid;
+    int32_t channel;
+    PackedByteArray packet;
+    Error error = host.get_packet(sender_host_peer_pid, channel, packet);
+    ERR_CONTINUE_MSG(error != OK, "Error when getting packet.");
+    // forwarding the packet as it is reuses this array instead of copying it
+    host.set_receiving(&packet);
+    MuxError result = core.receive(sender_host_peer_pid, channel, packet.ptr(), packet.size(), tick);
+    host.set_receiving(nullptr);
+    if (result != MUX_OK) {
+      report(sender_host_peer_pid, result);
+    }
+  }
+}
+
+void MultiplexDemux::report(int32_t sender_host_peer_pid, MuxError error) {
+  unreported_rejections++;
+  uint64_t now = Time::get_singleton()->get_ticks_msec();
+  if (now - last_rejection_report_msec >= REJECTION_REPORT_INTERVAL_MSEC) {
+    printf("MUXNET - DEMUX - dropped %d packets, latest from host_peer %d with error %d\n", unreported_rejections, sender_host_peer_pid, MultiplexPacket::to_error(error));
+    last_rejection_report_msec = now;
+    unreported_rejections = 0;
+  }
+}
+
+bool MultiplexDemux::Listener::admit_session(int32_t host_peer, uint16_t session) {
+  // A session id is only a number in the header, so a host peer that could pick any session could join every match
+  return !demux->session_admission.is_valid() || (bool)demux->session_admission.call(host_peer, session);
+}
+
+void MultiplexDemux::Listener::disconnect_host_peer(int32_t host_peer, uint32_t violations) {
+  printf("MUXNET - DEMUX - disconnecting host_peer %d after %d violations\n", host_peer, violations);
+  demux->host.disconnect_peer(host_peer);
+}
+
+void MultiplexDemux::set_max_packets_per_tick(int max_packets) {
+  ERR_FAIL_COND_MSG(max_packets < 0, "max_packets must not be negative");
+  core.set_max_packets_per_tick(max_packets);
+}
+
+int MultiplexDemux::get_max_packets_per_tick() {
+  return core.get_max_packets_per_tick();
+}
+
+void MultiplexDemux::set_max_bytes_per_tick(int max_bytes) {
+  ERR_FAIL_COND_MSG(max_bytes < 0, "max_bytes must not be negative");
+  core.set_max_bytes_per_tick(max_bytes);
+}
+
+int MultiplexDemux::get_max_bytes_per_tick() {
+  return core.get_max_bytes_per_tick();
+}
+
+void MultiplexDemux::set_violation_limit(int limit) {
+  ERR_FAIL_COND_MSG(limit < 0, "limit must not be negative");
+  core.set_violation_limit(limit);
+}
+
+int MultiplexDemux::get_violation_limit() {
+  return core.get_violation_limit();
+}
+
+void MultiplexDemux::set_session_admission(Callable admission) {
+  session_admission = admission;
+}
+
+Callable MultiplexDemux::get_session_admission() {
+  return session_admission;
+}
+
+MultiplexDemux::~MultiplexDemux() {
+  // networks keep their demux alive, so none can still be attached here
+  networks.clear();
+  if (host.is_valid()) {
+    host.close();
+  }
+}
+
+void MultiplexDemux::_bind_methods() {
+  ClassDB::bind_method(D_METHOD("set_host_peer", "host_peer"), &MultiplexDemux::set_host_peer);
+  ClassDB::bind_method(D_METHOD("get_host_peer"), &MultiplexDemux::get_host_peer);
+  ClassDB::bind_method(D_METHOD("add_network", "session_id", "network"), &MultiplexDemux::add_network);
+  ClassDB::bind_method(D_METHOD("remove_network", "session_id"), &MultiplexDemux::remove_network);
+  ClassDB::bind_method(D_METHOD("has_network", "session_id"), &MultiplexDemux::has_network);
+  ClassDB::bind_method(D_METHOD("get_network_count"), &MultiplexDemux::get_network_count);
+  ClassDB::bind_method(D_METHOD("poll"), &MultiplexDemux::poll);
+  ClassDB::bind_method(D_METHOD("set_max_packets_per_tick", "max_packets"), &MultiplexDemux::set_max_packets_per_tick);
+  ClassDB::bind_method(D_METHOD("get_max_packets_per_tick"), &MultiplexDemux::get_max_packets_per_tick);
+  ClassDB::bind_method(D_METHOD("set_max_bytes_per_tick", "max_bytes"), &MultiplexDemux::set_max_bytes_per_tick);
+  ClassDB::bind_method(D_METHOD("get_max_bytes_per_tick"), &MultiplexDemux::get_max_bytes_per_tick);
+  ClassDB::bind_method(D_METHOD("set_violation_limit", "limit"), &MultiplexDemux::set_violation_limit);
+  ClassDB::bind_method(D_METHOD("get_violation_limit"), &MultiplexDemux::get_violation_limit);
+  ClassDB::bind_method(D_METHOD("set_session_admission", "admission"), &MultiplexDemux::set_session_admission);
+  ClassDB::bind_method(D_METHOD("get_session_admission"), &MultiplexDemux::get_session_admission);
+  ClassDB::bind_method(D_METHOD("_callback_host_peer_connected", "to_host_peer_pid"), &MultiplexDemux::_callback_host_peer_connected);
+  ClassDB::bind_method(D_METHOD("_callback_host_peer_disconnected", "to_host_peer_pid"), &MultiplexDemux::_callback_host_peer_disconnected);
+}
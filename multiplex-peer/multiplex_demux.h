@@ -0,0 +1,76 @@
+#ifndef MULTIPLEX_DEMUX_H
+#define MULTIPLEX_DEMUX_H
+#include "godot_cpp/classes/ref_counted.hpp"
+#include "core/mux_demux.h"
+#include "multiplex_host_peer_adapter.h"
+#include <godot_cpp/classes/multiplayer_peer.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/variant/callable.hpp>
+
+using namespace godot;
+
+class MultiplexNetwork;
+// MultiplexDemux owns a host peer and dispatches its traffic to one MultiplexNetwork per session id.
+// Each network keeps its own subpeer id space (and its own server subpeer 1), so a dedicated server
+// can run many independent matches over a single listen socket.
+//
+// A MultiplexNetwork that is given a host peer directly through set_host_peer creates a private demux
+// holding only itself, so there is a single receive path either way.
+//
+// Networks hold a reference to their demux, the demux does not keep its networks alive.
+/*
+* var interface = SteamMultiplayerPeer.new()
+* interface.create_host(0)
+* var demux = MultiplexDemux.new()
+* demux.set_host_peer(interface)
+* for match_id in range(num_matches):
+*   var mux_net = MultiplexNetwork.new()
+*   demux.add_network(match_id, mux_net)
+*/
+class MultiplexDemux : public RefCounted {
+	GDCLASS(MultiplexDemux, RefCounted)
+private:
+	// what the core demux asks of Godot
+	struct Listener : public MuxDemuxListener {
+		MultiplexDemux *demux;
+		Listener(MultiplexDemux *demux) : demux(demux) {}
+		bool admit_session(int32_t host_peer, uint16_t session) override;
+		void disconnect_host_peer(int32_t host_peer, uint32_t violations) override;
+	};
+	MultiplexHostPeerAdapter host;
+	Listener listener;
+	MuxDemux core; // budgets, validation, session pinning and violation counts
+	HashMap<uint16_t, MultiplexNetwork *> networks;
+	Callable session_admission; // called with (host_peer_pid, session_id), returns whether the host peer may join
+	// rejected packets are reported at most once per REJECTION_REPORT_INTERVAL_MSEC
+	uint64_t last_rejection_report_msec = 0;
+	uint32_t unreported_rejections = 0;
+	void report(int32_t sender_host_peer_pid, MuxError error);
+protected:
+  static void _bind_methods();
+public:
+  void _callback_host_peer_connected(int to_host_peer_pid);
+  void _callback_host_peer_disconnected(int host_peer_pid);
+  void _detach_network(MultiplexNetwork *network);
+  void _release_host_peer(); // forgets the host peer without closing it
+	~MultiplexDemux();
+  Error set_host_peer(Ref<MultiplayerPeer> host_peer);
+	Ref<MultiplayerPeer> get_host_peer();
+	Error add_network(int session_id, Ref<MultiplexNetwork> network);
+	void remove_network(int session_id);
+	bool has_network(int session_id);
+	int get_network_count();
+	bool is_shared(); // true when more than one network is multiplexed over the host peer
+	void set_max_packets_per_tick(int max_packets);
+	int get_max_packets_per_tick();
+	void set_max_bytes_per_tick(int max_bytes);
+	int get_max_bytes_per_tick();
+	void set_violation_limit(int limit);
+	int get_violation_limit();
+	void set_session_admission(Callable admission);
+	Callable get_session_admission();
+	MultiplexDemux();
+	friend class MultiplexNetwork;
+	void poll(); // takes every packet off of host_peer and hands it to the network registered for its session
+};
+#endif
@@ -0,0 +1,146 @@
+#include "multiplex_host_peer_adapter.h"
+#include "godot_cpp/classes/global_constants.hpp"
+#include "godot_cpp/core/error_macros.hpp"
+#include <cstring>
+
+using namespace godot;
+
+void MultiplexHostPeerAdapter::set_peer(Ref<MultiplayerPeer> peer) {
+  this->peer = peer;
+  available_packets = 0;
+  invalidate();
+  if (peer.is_valid()) {
+    server_relay_supported = peer->is_server_relay_supported();
+    refresh();
+  }
+}
+
+Ref<MultiplayerPeer> MultiplexHostPeerAdapter::get_peer() const {
+  return peer;
+}
+
+bool MultiplexHostPeerAdapter::is_valid() const {
+  return peer.is_valid();
+}
+
+void MultiplexHostPeerAdapter::invalidate() {
+  last_target_peer = INT32_MIN;
+  last_channel = -1;
+  last_transfer_mode = -1;
+}
+
+void MultiplexHostPeerAdapter::refresh() {
+  MultiplayerPeer::ConnectionStatus status = peer->get_connection_status();
+  if (status != connection_status) {
+    // a reconnect may reset the host peer's transfer settings
+    invalidate();
+    connection_status = status;
+  }
+  unique_id = peer->get_unique_id();
+}
+
+int32_t MultiplexHostPeerAdapter::get_unique_id() const {
+  return unique_id;
+}
+
+bool MultiplexHostPeerAdapter::is_server() const {
+  return unique_id == 1;
+}
+
+bool MultiplexHostPeerAdapter::is_connected() const {
+  return connection_status == MultiplayerPeer::CONNECTION_CONNECTED;
+}
+
+MultiplayerPeer::ConnectionStatus MultiplexHostPeerAdapter::get_connection_status() const {
+  return connection_status;
+}
+
+bool MultiplexHostPeerAdapter::is_server_relay_supported() const {
+  return server_relay_supported;
+}
+
+Error MultiplexHostPeerAdapter::put_packet(int32_t target_peer, int32_t channel, MultiplayerPeer::TransferMode transfer_mode, const PackedByteArray &packet) {
+  ERR_FAIL_COND_V_MSG(peer.is_null(), godot::ERR_UNCONFIGURED, "host_peer not set");
+  if (transfer_mode != last_transfer_mode) {
+    peer->set_transfer_mode(transfer_mode);
+    last_transfer_mode = transfer_mode;
+  }
+  if (target_peer != last_target_peer) {
+    peer->set_target_peer(target_peer);
+    last_target_peer = target_peer;
+  }
+  if (channel != last_channel) {
+    peer->set_transfer_channel(channel);
+    last_channel = channel;
+  }
+  return peer->put_packet(packet);
+}
+
+MuxError MultiplexHostPeerAdapter::put_packet(const int32_t *targets, uint32_t count, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *header, uint32_t header_size, const uint8_t *payload, uint32_t payload_size) {
+  PackedByteArray packet;
+  if (receiving != nullptr && payload_size == 0 && header == receiving->ptr() && header_size == (uint32_t)receiving->size()) {
+    // copy on write, the host peer shares the array it was given
+    packet = *receiving;
+  }
+  else {
+    packet.resize(header_size + payload_size);
+    memcpy(packet.ptrw(), header, header_size);
+    if (payload_size != 0) {
+      memcpy(packet.ptrw() + header_size, payload, payload_size);
+    }
+  }
+  MuxError error = MUX_OK;
+  for (uint32_t i = 0; i < count; i++) {
+    if (put_packet(targets[i], channel, (MultiplayerPeer::TransferMode)transfer_mode, packet) != OK) {
+      error = MUX_ERR_TRANSPORT;
+    }
+  }
+  return error;
+}
+
+void MultiplexHostPeerAdapter::set_receiving(const PackedByteArray *packet) {
+  receiving = packet;
+}
+
+int32_t MultiplexHostPeerAdapter::poll() {
+  if (peer.is_null()) {
+    return 0;
+  }
+  peer->poll();
+  refresh();
+  // nothing else pops packets off the host peer, so the count only changes by what get_packet takes
+  available_packets = peer->get_available_packet_count();
+  return available_packets;
+}
+
+Error MultiplexHostPeerAdapter::get_packet(int32_t &r_sender_pid, int32_t &r_channel, PackedByteArray &r_packet) {
+  ERR_FAIL_COND_V_MSG(peer.is_null() || available_packets <= 0, godot::ERR_UNAVAILABLE, "No packets available on host_peer.");
+  available_packets--;
+  r_sender_pid = peer->get_packet_peer();
+  r_channel = peer->get_packet_channel();
+  r_packet = peer->get_packet();
+  if (r_packet.is_empty()) {
+    // get_packet returns an empty array on failure, only then is the error worth asking for
+    return peer->get_packet_error();
+  }
+  return OK;
+}
+
+void MultiplexHostPeerAdapter::disconnect_peer(int32_t host_peer_pid, bool force) {
+  ERR_FAIL_COND_MSG(peer.is_null(), "host_peer not set");
+  peer->disconnect_peer(host_peer_pid, force);
+  // the host peer may drop what the disconnected peer still had queued
+  available_packets = peer->get_available_packet_count();
+}
+
+int32_t MultiplexHostPeerAdapter::get_available_packet_count() const {
+  return available_packets;
+}
+
+void MultiplexHostPeerAdapter::close() {
+  ERR_FAIL_COND_MSG(peer.is_null(), "host_peer not set");
+  peer->close();
+  available_packets = 0;
+  connection_status = MultiplayerPeer::CONNECTION_DISCONNECTED;
+  invalidate();
+}
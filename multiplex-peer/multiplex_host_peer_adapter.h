@@ -0,0 +1,51 @@
+#ifndef MULTIPLEX_HOST_PEER_ADAPTER_H
+#define MULTIPLEX_HOST_PEER_ADAPTER_H
+#include "core/mux_transport.h"
+#include <cstdint>
+#include <godot_cpp/classes/multiplayer_peer.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+
+using namespace godot;
+
+// Every call into the host peer is a method bind call across the GDExtension boundary, so the hot paths
+// go through this adapter instead of the host peer itself.
+//  - target peer, channel and transfer mode are only set when they differ from the last packet sent
+//  - unique id, connection status and relay support are read once per poll instead of once per use
+//  - receiving reads the packet count once per poll and skips get_packet_error for non empty packets
+// This only holds while the adapter is the only thing configuring the host peer, which MultiplexDemux
+// guarantees by owning it. It is also the core's MuxTransport.
+class MultiplexHostPeerAdapter : public MuxTransport {
+private:
+	Ref<MultiplayerPeer> peer;
+	int32_t unique_id = 0;
+	MultiplayerPeer::ConnectionStatus connection_status = MultiplayerPeer::CONNECTION_DISCONNECTED;
+	bool server_relay_supported = false;
+	int32_t available_packets = 0;
+	const PackedByteArray *receiving = nullptr; // the packet being handed to the core, if any
+	// last values handed to the host peer, invalid until the first packet is sent
+	int32_t last_target_peer = INT32_MIN;
+	int32_t last_channel = -1;
+	int32_t last_transfer_mode = -1;
+	void invalidate();
+public:
+	void set_peer(Ref<MultiplayerPeer> peer);
+	Ref<MultiplayerPeer> get_peer() const;
+	bool is_valid() const;
+	void refresh(); // re-reads the cached host peer state, done on every poll
+	int32_t get_unique_id() const override;
+	bool is_server() const override;
+	MultiplayerPeer::ConnectionStatus get_connection_status() const;
+	bool is_server_relay_supported() const;
+	bool is_connected() const override;
+	Error put_packet(int32_t target_peer, int32_t channel, MultiplayerPeer::TransferMode transfer_mode, const PackedByteArray &packet);
+	// builds one PackedByteArray for all targets, or reuses the received packet when that is what is forwarded
+	MuxError put_packet(const int32_t *targets, uint32_t count, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *header, uint32_t header_size, const uint8_t *payload, uint32_t payload_size) override;
+	void set_receiving(const PackedByteArray *packet);
+	int32_t poll(); // polls the host peer, returns the number of packets to drain with get_packet
+	// packets left from the last poll, drops to 0 when the host peer is closed or replaced while draining
+	int32_t get_available_packet_count() const;
+	Error get_packet(int32_t &r_sender_pid, int32_t &r_channel, PackedByteArray &r_packet);
+	void disconnect_peer(int32_t host_peer_pid, bool force = false);
+	void close();
+};
+#endif
@@ -1,70 +1,159 @@
 #include "multiplex_network.h"
-#include "godot_cpp/classes/cone_twist_joint3d.hpp"
+#include "godot_cpp/classes/crypto.hpp"
 #include "godot_cpp/classes/global_constants.hpp"
+#include "godot_cpp/classes/time.hpp"
 #include "godot_cpp/classes/multiplayer_peer.hpp"
 #include "godot_cpp/core/class_db.hpp"
 #include "godot_cpp/core/error_macros.hpp"
-#include "godot_cpp/variant/callable.hpp"
 #include "godot_cpp/variant/packed_byte_array.hpp"
 #include "multiplex_packet.h"
 #include "multiplex_peer.h"
 #include <cstdio>
+#include <cstring>
 
 using namespace godot;
 
+MultiplexNetwork::MultiplexNetwork() :
+		listener(this), session(listener) {
+}
+
 Error MultiplexNetwork::set_host_peer(Ref<MultiplayerPeer> host_peer) {
-	this->host_peer = host_peer;
+  // A network with its own host peer is the only network of a private demux
+  Ref<MultiplexDemux> demux = Ref<MultiplexDemux>(memnew(MultiplexDemux));
+  Error error = demux->set_host_peer(host_peer);
+  ERR_FAIL_COND_V(error != OK, error);
+  return demux->add_network(session.get_session_id(), Ref<MultiplexNetwork>(this));
+}
+
+void MultiplexNetwork::_attach(MultiplexDemux *demux) {
+	// the demux has attached the session to its host peer
+	this->demux = Ref<MultiplexDemux>(demux);
+	this->host = &demux->host;
 	internal_peers = HashMap<int32_t, Ref<MultiplexPeer>>();
-	external_peers = HashMap<int32_t, int32_t>();
-  host_peer->connect("peer_connected", Callable(this, "_callback_host_peer_connected"));
-  host_peer->connect("peer_disconnected", Callable(this, "_callback_host_peer_disconnected"));
+	session.reset();
+}
+
+void MultiplexNetwork::_detach() {
+	session.attach(nullptr);
+	this->host = nullptr;
+	this->demux = Ref<MultiplexDemux>();
+}
+
+Error MultiplexNetwork::set_session_id(int session_id) {
+  ERR_FAIL_COND_V_MSG(demux.is_valid(), godot::ERR_ALREADY_IN_USE, "session_id must be set before the network is given a host peer");
+  ERR_FAIL_COND_V_MSG(session_id < 0 || session_id > UINT16_MAX, godot::ERR_PARAMETER_RANGE_ERROR, "session_id must be between 0 and 65535");
+  session.set_session_id(session_id);
   return OK;
 }
 
-void MultiplexNetwork::_callback_host_peer_connected(int to_host_peer_pid) {
-  printf("MUXNET - host_peer %d connected to host_peer %d\n", host_peer->get_unique_id(), to_host_peer_pid);
-  if (to_host_peer_pid == 1) {
-    this->external_peers.insert(1, 1);
-    for (auto e = this->internal_peers.begin(); e != this->internal_peers.end(); ++e) {
-      send_command(MUX_CMD_ADD_PEER, e->value->get_unique_id(), 1);
-    }
+int MultiplexNetwork::get_session_id() {
+  return session.get_session_id();
+}
+
+Ref<MultiplexDemux> MultiplexNetwork::get_demux() {
+  return demux;
+}
+
+void MultiplexNetwork::set_delta_encoding(bool enabled) {
+  session.set_delta_encoding(enabled);
+}
+
+bool MultiplexNetwork::is_delta_encoding() {
+  return session.is_delta_encoding();
+}
+
+void MultiplexNetwork::set_resume_grace_period_msec(int grace_period_msec) {
+  ERR_FAIL_COND_MSG(grace_period_msec < 0, "grace_period_msec must not be negative");
+  session.set_resume_grace_period_msec(grace_period_msec);
+}
+
+int MultiplexNetwork::get_resume_grace_period_msec() {
+  return session.get_resume_grace_period_msec();
+}
+
+void MultiplexNetwork::set_header_forwarding(bool enabled) {
+  session.set_header_forwarding(enabled);
+}
+
+bool MultiplexNetwork::is_header_forwarding() {
+  return session.is_header_forwarding();
+}
+
+void MultiplexNetwork::Listener::subpeer_connected(int32_t to_subpeer, int32_t subpeer) {
+  Ref<MultiplexPeer> *peer = network->internal_peers.getptr(to_subpeer);
+  if (peer != nullptr) {
+    (*peer)->emit_signal("peer_connected", subpeer);
   }
-  else {
-    // Client must now initiate some requests regarding adding subpeers.
+}
+
+void MultiplexNetwork::Listener::subpeer_disconnected(int32_t to_subpeer, int32_t subpeer) {
+  Ref<MultiplexPeer> *peer = network->internal_peers.getptr(to_subpeer);
+  if (peer != nullptr) {
+    (*peer)->emit_signal("peer_disconnected", subpeer);
   }
 }
 
-void MultiplexNetwork::_callback_host_peer_disconnected(int to_host_peer_pid) {
-  printf("MUXNET - host_peer %d disconnected from host_peer %d\n", to_host_peer_pid, host_peer->get_unique_id());
-  if (to_host_peer_pid == 1) {
-    for (auto e = this->internal_peers.begin(); e != this->internal_peers.end(); ++e) {
-      e->value->close();
-    }
-    this->internal_peers.clear();
-    this->external_peers.clear();
+void MultiplexNetwork::Listener::local_subpeer_connected(int32_t subpeer) {
+  Ref<MultiplexPeer> *peer = network->internal_peers.getptr(subpeer);
+  if (peer != nullptr) {
+    (*peer)->connection_status = MultiplayerPeer::CONNECTION_CONNECTED;
   }
-  else {
-    List<int> to_delete;
-    for (auto e = this->external_peers.begin(); e != this->external_peers.end(); ++e) {
-      if (e->value == to_host_peer_pid) {
-        to_delete.push_back(e->key);
-      }
-    }
-    for (auto e = to_delete.begin(); e != to_delete.end(); ++e) {
-      if (this->internal_peers.has(1)) {
-        this->internal_peers.get(1)->emit_signal("peer_disconnected", *e);
-      }
-      this->external_peers.erase(*e);
+}
+
+void MultiplexNetwork::Listener::local_subpeer_closed(int32_t subpeer) {
+  // The session has already forgotten the subpeer, closing it only resets the MultiplexPeer
+  Ref<MultiplexPeer> *found = network->internal_peers.getptr(subpeer);
+  if (found == nullptr) {
+    return;
+  }
+  printf("MUXNET - session closed subpeer %d\n", subpeer);
+  Ref<MultiplexPeer> peer = *found;
+  network->internal_peers.erase(subpeer);
+  peer->close();
+}
+
+void MultiplexNetwork::Listener::deliver(int32_t source, int32_t dest, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *payload, uint32_t length) {
+  (void)channel;
+  // Sent from here, the packet the sender built is queued as it is. Anything received is copied once and every
+  // recipient of a broadcast shares the copy.
+  Ref<MultiplexPacket> packet = network->sending;
+  if (packet.is_null() || payload != packet->payload.ptr()) {
+    packet = Ref<MultiplexPacket>(memnew(MultiplexPacket));
+    packet->subtype = MUX_DATA;
+    packet->transfer_mode = (MultiplayerPeer::TransferMode)transfer_mode;
+    packet->session = network->session.get_session_id();
+    packet->contents.data.mux_peer_source = source;
+    packet->contents.data.mux_peer_dest = dest;
+    packet->contents.data.length = length;
+    packet->payload.resize(length);
+    if (length != 0) {
+      memcpy(packet->payload.ptrw(), payload, length);
     }
   }
+  network->deliver_local(packet);
+}
+
+uint64_t MultiplexNetwork::Listener::get_ticks_msec() {
+  return Time::get_singleton()->get_ticks_msec();
+}
+
+uint64_t MultiplexNetwork::Listener::generate_random_u64() {
+  // the OS's CSPRNG
+  Ref<Crypto> crypto;
+  crypto.instantiate();
+  return (uint64_t)crypto->generate_random_bytes(8).decode_u64(0);
 }
 
 MultiplexNetwork::~MultiplexNetwork() {
-	this->host_peer->close();
-	for (HashMap<int32_t, Ref<MultiplexPeer>>::Iterator E = this->internal_peers.begin(); E; ++E) {
+	// the host peer is closed by the demux once no network references it
+	if (this->demux.is_valid()) {
+		this->demux->_detach_network(this);
+	}
+	// Closing a subpeer erases it, so they are closed from a copy
+	HashMap<int32_t, Ref<MultiplexPeer>> peers = this->internal_peers;
+	for (HashMap<int32_t, Ref<MultiplexPeer>>::Iterator E = peers.begin(); E; ++E) {
 		E->value->_close();
 	}
-	this->external_peers.clear();
 	this->internal_peers.clear();
 }
 
@@ -73,23 +162,22 @@ Error MultiplexNetwork::send(
 		int32_t peer_id,
 		int32_t channel,
 		MultiplayerPeer::TransferMode transfer_mode) {
-	if (this->internal_peers.has(peer_id)) {
-		Ref<MultiplexPeer> peer;
-		peer = this->internal_peers.get(peer_id);
-		peer->_put_multiplex_packet_direct(packet);
-		return OK;
-	} else if (this->external_peers.has(peer_id)) {
-		this->host_peer->set_transfer_mode(transfer_mode);
-		this->host_peer->set_target_peer(this->external_peers.get(peer_id));
-		this->host_peer->set_transfer_channel(channel);
-		return this->host_peer->put_packet(packet->serialize());
-	} else {
+	packet->session = session.get_session_id();
+	sending = packet;
+	MuxError error = session.send(packet->contents.data.mux_peer_source, peer_id, channel, (MuxTransferMode)transfer_mode, packet->payload.ptr(), packet->payload.size());
+	sending = Ref<MultiplexPacket>();
+	if (error == MUX_ERR_UNKNOWN_SUBPEER) {
 		ERR_FAIL_V_MSG(godot::ERR_CANT_CONNECT, "No known peer for peer_id");
 	}
+	return MultiplexPacket::to_error(error);
+}
+
+bool MultiplexNetwork::is_offline() {
+	return session.is_offline();
 }
 
 bool MultiplexNetwork::is_peer_connected(int32_t mux_peer_id) {
-	return this->internal_peers.has(mux_peer_id) || this->external_peers.has(mux_peer_id);
+	return session.has_subpeer(mux_peer_id);
 }
 
 Error MultiplexNetwork::disconnect_peer(int32_t mux_peer_id, bool force) {
@@ -101,215 +189,66 @@ Error MultiplexNetwork::disconnect_peer(int32_t mux_peer_id, bool force) {
 }
 
 void MultiplexNetwork::poll() {
-  Error error = godot::OK;
-	this->host_peer->poll();
-  if (this->host_peer->get_available_packet_count() == 0) {
-    return;
-  }
-	while (this->host_peer->get_available_packet_count()) {
-    // printf("MUXNET - Num packets: %d\n", this->host_peer->get_available_packet_count());
-		int32_t sender_host_peer_pid = this->host_peer->get_packet_peer();
-		PackedByteArray packet = this->host_peer->get_packet();
-    error = this->host_peer->get_packet_error();
-    ERR_CONTINUE_MSG(error != OK, "Error when getting packet.");
-		Ref<MultiplexPacket> multiplex_packet = Ref<MultiplexPacket>(memnew(MultiplexPacket));
-		error = multiplex_packet->deserialize(packet);
-    // printf("MUXNET - packet retrieved\n");
-		ERR_CONTINUE_MSG(
-				error != OK, "Deserializing packet failed.");
-		// These packets are received from a remote network
-		// They inform this network that a change has occurred
-		// Control packets are handled at the MultiplexNetwork level
-		// Data packets are put into their corresponding network packet
-		switch (multiplex_packet->subtype) {
-			case MUX_CMD:
-				if (host_peer->get_unique_id() == 1) {
-					handle_command_dom(sender_host_peer_pid, multiplex_packet);
-				} else {
-					handle_command_sub(sender_host_peer_pid, multiplex_packet);
-				}
-				break;
-			case MUX_DATA:
-				ERR_CONTINUE_MSG(
-						multiplex_packet->contents.data.mux_peer_dest != 0 && !internal_peers.has(multiplex_packet->contents.data.mux_peer_dest),
-						"Multiplex destination peer id is not available locally");
-				ERR_CONTINUE_MSG(
-						!external_peers.has(multiplex_packet->contents.data.mux_peer_source),
-						"Multiplex source peer id is not associated with any remote host_peer");
-				ERR_CONTINUE_MSG(
-						external_peers.get(multiplex_packet->contents.data.mux_peer_source) != sender_host_peer_pid,
-						"Multiplex source peer id is not associated with the provided host_peer peer id. Possible attempt at cheating.");
-				internal_peers.get(multiplex_packet->contents.data.mux_peer_dest)->_put_multiplex_packet_direct(multiplex_packet);
-				break;
-		}
+	if (this->demux.is_valid()) {
+		this->demux->poll();
+	}
+	if (session.get_resume_grace_period_msec() != 0) {
+		session.update();
 	}
-  // printf("MUXNET - All packets processed.");
 }
 
-Error MultiplexNetwork::handle_command_dom(int32_t sender_pid, Ref<MultiplexPacket> multiplex_packet) {
-	printf("MUXNET - DOM - Received command %d from host_peer %d about peer %d.\n", multiplex_packet->contents.command.subtype, sender_pid, multiplex_packet->contents.command.subject_multiplex_peer);
-  switch (multiplex_packet->contents.command.subtype) {
-		case MUX_CMD_ADD_PEER: {
-      printf("MUXNET - DOM - Received command MUX_CMD_ADD_PEER\n");
-			// register peer and ack
-			// make sure no existing peer has the requested unique_id
-			if (internal_peers.has(multiplex_packet->contents.command.subject_multiplex_peer) || external_peers.has(multiplex_packet->contents.command.subject_multiplex_peer)) {
-				send_command(
-            MUX_CMD_ERR_SUBPEER_ID_EXISTS, 
-            multiplex_packet->contents.command.subject_multiplex_peer, 
-            sender_pid);
-				ERR_FAIL_V_MSG(godot::ERR_ALREADY_EXISTS, "Server rejected add peer request: peer with requested id already exists");
-			}
-			// make sure the number of existing peers containing the sender's base pid is less than the max
-			uint32_t count = 0;
-			if (max_subpeers != 0) {
-				for (HashMap<int32_t, int32_t>::Iterator E = external_peers.begin(); E; ++E) {
-					if (E->value == sender_pid) {
-						count++;
-						if (count >= max_subpeers) {
-              send_command(
-                  MUX_CMD_ERR_SUBPEERS_EXCEEDED, 
-                  multiplex_packet->contents.command.subject_multiplex_peer, 
-                  sender_pid);
-				      ERR_FAIL_V_MSG(godot::ERR_CANT_CREATE, "Server rejected add peer request: peer with requested id already exists");
-							break;
-						}
-					}
-				}
-			}
-      printf("MUXNET - DOM - Inserting peer into external list\n");
-      external_peers.insert(
-          multiplex_packet->contents.command.subject_multiplex_peer,
-          sender_pid);
-      printf("MUXNET - DOM - Telling peer 1 about the connection\n");
-      internal_peers.get(1)->emit_signal("peer_connected", multiplex_packet->contents.command.subject_multiplex_peer);
-      printf("MUXNET - DOM - Sending ACK\n");
-      return send_command(MUX_CMD_ADD_PEER_ACK, multiplex_packet->contents.command.subject_multiplex_peer, sender_pid);
+Error MultiplexNetwork::deliver_local(Ref<MultiplexPacket> packet) {
+	int32_t dest = packet->contents.data.mux_peer_dest;
+	if (dest > 0) {
+		Ref<MultiplexPeer> *peer = internal_peers.getptr(dest);
+		if (peer == nullptr) {
+			return godot::ERR_DOES_NOT_EXIST;
 		}
-    case MUX_CMD_REMOVE_PEER: {
-      int subject = multiplex_packet->contents.command.subject_multiplex_peer;
-      printf("MUXNET - DOM - Request to remove subpeer %d\n", subject);
-      if (sender_pid != host_peer->get_unique_id()) {
-        ERR_FAIL_COND_V_MSG(!external_peers.has(subject), godot::ERR_DOES_NOT_EXIST, "MUXNET - DOM - Requested peer to remove does not exist.");
-        ERR_FAIL_COND_V_MSG(external_peers.get(subject) != sender_pid, godot::ERR_UNAUTHORIZED, "MUXNET - Peer removal command was not sent by owner of peer.");
-        internal_peers.get(1)->disconnect_peer(subject);
-        external_peers.erase(subject);
-      }
-      else {
-        ERR_FAIL_COND_V_MSG(!internal_peers.has(subject), godot::ERR_DOES_NOT_EXIST, "MUXNET - DOM - Requested peer to remove does not exist.");
-        internal_peers.get(1)->disconnect_peer(subject);
-        internal_peers.erase(subject);
-      }
-      return godot::OK;
-    }
-		default:
-			ERR_FAIL_V_MSG(godot::ERR_INVALID_PARAMETER, "MUXNET - DOM - Does not respond to provided command");
+		return (*peer)->_put_multiplex_packet_direct(packet);
 	}
-	ERR_FAIL_V_MSG(godot::ERR_BUG, "Server handle command reached unreachable line. What!?");
-}
-
-Error MultiplexNetwork::handle_command_sub(int32_t sender_pid, Ref<MultiplexPacket> multiplex_packet) {
-	printf("MUXNET - SUB - Received command %d from host_peer %d about peer %d\n", multiplex_packet->contents.command.subtype, sender_pid, multiplex_packet->contents.command.subject_multiplex_peer);
-  int subject = multiplex_packet->contents.command.subject_multiplex_peer;
-  switch (multiplex_packet->contents.command.subtype) {
-		case MUX_CMD_ADD_PEER:
-			external_peers.insert(
-					multiplex_packet->contents.command.subject_multiplex_peer,
-					sender_pid);
-      return godot::OK;
-		case MUX_CMD_ADD_PEER_ACK:
-			// Always client receiving from server
-			ERR_FAIL_COND_V_MSG(
-					!internal_peers.has(
-							multiplex_packet->contents.command.subject_multiplex_peer),
-					godot::ERR_DOES_NOT_EXIST,
-					"Subject peer of ACK is not local.");
-			internal_peers.get(multiplex_packet->contents.command.subject_multiplex_peer)->complete_connection();
-      return godot::OK;
-    case MUX_CMD_REMOVE_PEER: {
-      // Server is telling us they have removed this peer
-      printf("MUXNET - SUB - Server forced removed peer %d\n", subject);
-      ERR_FAIL_COND_V_MSG(!internal_peers.has(subject), ERR_DOES_NOT_EXIST, "MUXNET - SUB - Peer to remove not present");
-      internal_peers.get(subject)->close();
-      internal_peers.erase(subject);
-      return godot::OK;
-    }
-		case MUX_CMD_ERR_SUBPEERS_EXCEEDED:
-      printf("MUXNET - SUB - Server NACK'd %d: Max subpeers exceeded\n", subject);
-      ERR_FAIL_COND_V_MSG(!internal_peers.has(subject), ERR_DOES_NOT_EXIST, "MUXNET - SUB - nack'd subpeer does not exist.");
-			internal_peers.get(multiplex_packet->contents.command.subject_multiplex_peer)->close();
-			ERR_FAIL_V_MSG(godot::ERR_CANT_CONNECT, "MUXNET - SUB - received add peer error: maximum subpeers exceeded.");
-      return godot::OK;
-		case MUX_CMD_ERR_SUBPEER_ID_EXISTS:
-      printf("MUXNET - SUB - Server NACK'd %d: Subpeer with pid already exists.\n", subject);
-      ERR_FAIL_COND_V_MSG(!internal_peers.has(subject), ERR_DOES_NOT_EXIST, "MUXNET - SUB - nack'd subpeer does not exist.");
-			internal_peers.get(multiplex_packet->contents.command.subject_multiplex_peer)->close();
-			ERR_FAIL_V_MSG(godot::ERR_CANT_CONNECT, "MUXNET - SUB - Client received add peer error: subpeer ID collision.");
-		default:
-			ERR_FAIL_V_MSG(godot::ERR_INVALID_PARAMETER, "MUXNET - SUB - Client mode MultiplexNetworks don't respond to provided command");
+	// Every recipient queues the same packet, the payload is shared rather than copied
+	int32_t source = packet->contents.data.mux_peer_source;
+	int32_t excluded = mux_broadcast_excluded(dest);
+	for (HashMap<int32_t, Ref<MultiplexPeer>>::Iterator E = internal_peers.begin(); E; ++E) {
+		if (E->key != source && E->key != excluded) {
+			E->value->_put_multiplex_packet_direct(packet);
+		}
 	}
-  ERR_FAIL_V_MSG(godot::ERR_BUG, "MUXNET - SUB - Client handle command reached unreachable line. What!?");
+	return OK;
 }
 
 Error MultiplexNetwork::_register_mux_peer(MultiplexPeer *peer) {
   ERR_FAIL_COND_V_MSG(internal_peers.has(peer->get_unique_id()),ERR_ALREADY_EXISTS,"Local peer with pid already exists");
-  ERR_FAIL_COND_V_EDMSG(host_peer.is_null(), godot::ERR_DOES_NOT_EXIST, "host_peer not set");
-  ERR_FAIL_COND_V_EDMSG(!host_peer.is_valid(), godot::ERR_UNCONFIGURED, "host_peer registered but not valid");
+  ERR_FAIL_COND_V_EDMSG(host != nullptr && !host->is_valid(), godot::ERR_UNCONFIGURED, "host_peer registered but not valid");
   printf("MUXNET - registering internal mux peer %d\n", peer->get_unique_id());
   this->internal_peers.insert(peer->get_unique_id(), Ref<MultiplexPeer>(peer));
-  if (host_peer->get_unique_id() != 1 && host_peer->get_connection_status() == godot::MultiplayerPeer::CONNECTION_CONNECTED) {
-    printf("MUXNET - requesting add of late subpeer");
-    send_command(MUX_CMD_ADD_PEER, peer->get_unique_id(), 1);
+  // Offline, clients connect on their next poll once subpeer 1 exists. A client that is already connected asks
+  // the server for the subpeer.
+  if (session.add_local_subpeer(peer->get_unique_id()) != MUX_OK) {
+    internal_peers.erase(peer->get_unique_id());
+    ERR_FAIL_V_MSG(ERR_ALREADY_EXISTS, "Peer with pid already exists in the session");
   }
   return OK;
 }
 
-void MultiplexNetwork::_remove_mux_peer(MultiplexPeer *peer) {
-  internal_peers.erase(peer->get_unique_id());
-}
-
-Error MultiplexNetwork::send_command(MultiplexPacketCommandSubtype subtype, int32_t subject_multiplex_peer, int32_t to_host_peer_pid) {
-  printf("MUXNET - sending command %d about %d to %d\n", subtype, subject_multiplex_peer, to_host_peer_pid);
-  Ref<MultiplexPacket> packet = Ref<MultiplexPacket>(memnew(MultiplexPacket));
-  packet->subtype = MUX_CMD;
-  packet->transfer_mode = godot::MultiplayerPeer::TRANSFER_MODE_RELIABLE;
-  packet->contents.command.subtype = subtype;
-  packet->contents.command.subject_multiplex_peer = subject_multiplex_peer;
-  if (to_host_peer_pid == host_peer->get_unique_id()) {
-    // loopback;
-    if (this->host_peer->get_unique_id() == 1) {
-      return this->handle_command_dom(this->host_peer->get_unique_id(), packet);
-    }
-    else {
-      return this->handle_command_sub(this->host_peer->get_unique_id(), packet);
-    }
-  }
-  else {
-    host_peer->set_target_peer(to_host_peer_pid);
-    host_peer->set_transfer_channel(1);
-    host_peer->set_transfer_mode(MultiplayerPeer::TRANSFER_MODE_RELIABLE);
-    return host_peer->put_packet(packet->serialize());
-  }
-}
-
 Ref<MultiplayerPeer> MultiplexNetwork::_get_host_peer() {
-  return host_peer;
+  return host == nullptr ? Ref<MultiplayerPeer>() : host->get_peer();
 }
 
 int MultiplexNetwork::get_host_peer_id_from_subpeer_id(int subpeer_id) {
-  if (internal_peers.has(subpeer_id)) {
-    return host_peer->get_unique_id();
-  }
-  else if (external_peers.has(subpeer_id)) {
-    return external_peers.get(subpeer_id);
-  }
-  return -1;
+  return session.get_subpeer_host_peer(subpeer_id);
 }
 
 void MultiplexNetwork::_bind_methods() {
   ClassDB::bind_method(D_METHOD("set_host_peer", "host_peer"), &MultiplexNetwork::set_host_peer);
-  ClassDB::bind_method(D_METHOD("_callback_host_peer_connected", "to_host_peer_pid"), &MultiplexNetwork::_callback_host_peer_connected);
-  ClassDB::bind_method(D_METHOD("_callback_host_peer_disconnected", "to_host_peer_pid"), &MultiplexNetwork::_callback_host_peer_disconnected);
   ClassDB::bind_method(D_METHOD("get_host_peer_id_from_subpeer_id", "subpeer_id"), &MultiplexNetwork::get_host_peer_id_from_subpeer_id);
+  ClassDB::bind_method(D_METHOD("set_session_id", "session_id"), &MultiplexNetwork::set_session_id);
+  ClassDB::bind_method(D_METHOD("get_session_id"), &MultiplexNetwork::get_session_id);
+  ClassDB::bind_method(D_METHOD("get_demux"), &MultiplexNetwork::get_demux);
+  ClassDB::bind_method(D_METHOD("set_delta_encoding", "enabled"), &MultiplexNetwork::set_delta_encoding);
+  ClassDB::bind_method(D_METHOD("is_delta_encoding"), &MultiplexNetwork::is_delta_encoding);
+  ClassDB::bind_method(D_METHOD("set_resume_grace_period_msec", "grace_period_msec"), &MultiplexNetwork::set_resume_grace_period_msec);
+  ClassDB::bind_method(D_METHOD("get_resume_grace_period_msec"), &MultiplexNetwork::get_resume_grace_period_msec);
+  ClassDB::bind_method(D_METHOD("set_header_forwarding", "enabled"), &MultiplexNetwork::set_header_forwarding);
+  ClassDB::bind_method(D_METHOD("is_header_forwarding"), &MultiplexNetwork::is_header_forwarding);
 }
-
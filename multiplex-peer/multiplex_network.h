@@ -1,39 +1,68 @@
 #ifndef MULTIPLEX_NETWORK_H
 #define MULTIPLEX_NETWORK_H
 #include "godot_cpp/classes/ref_counted.hpp"
+#include "core/mux_session.h"
+#include "multiplex_demux.h"
 #include "multiplex_packet.h"
 #include <godot_cpp/classes/multiplayer_peer.hpp>
 #include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/list.hpp>
 
 using namespace godot;
 
 class MultiplexPeer;
+// MultiplexNetwork is the Godot face of one core MuxSession. The session keeps the subpeer tables and runs the
+// protocol, the network keeps the MultiplexPeer of each local subpeer and turns what the session reports into
+// their signals and packet queues.
 class MultiplexNetwork : public RefCounted {
 	GDCLASS(MultiplexNetwork, RefCounted)
 private:
 	HashMap<int32_t, Ref<MultiplexPeer>> internal_peers;
-	HashMap<int32_t, int32_t> external_peers;
-	Ref<MultiplayerPeer> host_peer;
-	uint32_t max_subpeers; // 0 = inf
-	Error handle_command_dom(int32_t sender_pid, Ref<MultiplexPacket> packet);
-	Error handle_command_sub(int32_t sender_pid, Ref<MultiplexPacket> packet);
-  Error send_command(MultiplexPacketCommandSubtype subtype, int32_t subject_multiplex_peer, int32_t to_host_peer_pid);
+	// what the session reports, emitted on internal_peers
+	struct Listener : public MuxSessionListener {
+		MultiplexNetwork *network;
+		Listener(MultiplexNetwork *network) : network(network) {}
+		void subpeer_connected(int32_t to_subpeer, int32_t subpeer) override;
+		void subpeer_disconnected(int32_t to_subpeer, int32_t subpeer) override;
+		void local_subpeer_connected(int32_t subpeer) override;
+		void local_subpeer_closed(int32_t subpeer) override;
+		void deliver(int32_t source, int32_t dest, int32_t channel, MuxTransferMode transfer_mode, const uint8_t *payload, uint32_t length) override;
+		uint64_t get_ticks_msec() override;
+		uint64_t generate_random_u64() override;
+	};
+	Listener listener;
+	MuxSession session;
+	MultiplexHostPeerAdapter *host = nullptr; // owned by demux, null while detached
+	Ref<MultiplexDemux> demux;
+	// the packet being sent, local subpeers queue it instead of a copy of its payload
+	Ref<MultiplexPacket> sending;
+	Error deliver_local(Ref<MultiplexPacket> packet);
 protected:
   static void _bind_methods();
 public:
-  void _callback_host_peer_connected(int to_host_peer_pid);
-  void _callback_host_peer_disconnected(int host_peer_pid);
+	MultiplexNetwork();
   int get_host_peer_id_from_subpeer_id(int subpeer_id);
 	Error _register_mux_peer(MultiplexPeer *peer);
-	void _remove_mux_peer(MultiplexPeer *peer);
-  void _close();
+	void _attach(MultiplexDemux *demux);
+	void _detach();
 	~MultiplexNetwork();
   Error set_host_peer(Ref<MultiplayerPeer> host_peer);
+	Error set_session_id(int session_id);
+	int get_session_id();
+	Ref<MultiplexDemux> get_demux();
+	void set_delta_encoding(bool enabled);
+	bool is_delta_encoding();
+	void set_resume_grace_period_msec(int grace_period_msec);
+	int get_resume_grace_period_msec();
+	void set_header_forwarding(bool enabled);
+	bool is_header_forwarding();
 	Error send(Ref<MultiplexPacket> packet, int32_t peer_id, int32_t channel, MultiplayerPeer::TransferMode transfer_mode);
 	bool is_peer_connected(int32_t mux_peer_id);
 	Error disconnect_peer(int32_t mux_peer_id, bool force);
-	void poll(); // responsible for taking packets off of host_peer, validating them, handling commands, and putting data packets into the correct MultiplexPeer queue, may be called multiple times in one frame
+	bool is_offline(); // no host peer, subpeers only reach each other
+	void poll(); // polls the demux, which hands the session the packets for it, may be called multiple times in one frame
 	Ref<MultiplayerPeer> _get_host_peer();
   friend class MultiplexPeer;
+  friend class MultiplexDemux;
 };
 #endif
@@ -40,7 +40,7 @@ Error MultiplexPeer::_get_packet(const uint8_t **r_buffer, int32_t *r_buffer_siz
 	incoming_packets.pop_front();
   
 
-	*r_buffer = this->current_packet->contents.data.data;
+	*r_buffer = this->current_packet->payload.ptr();
 	*r_buffer_size = this->current_packet->contents.data.length;
 
 	return OK;
@@ -49,7 +49,7 @@ Error MultiplexPeer::_put_packet(const uint8_t *p_buffer, int32_t p_buffer_size)
   // printf("MUXNET - PEER - %d put packet called, target is %d\n", unique_id, this->target_peer);
 	ERR_FAIL_COND_V_MSG(active_mode == MODE_NONE, ERR_UNCONFIGURED, "Peer is not in a MultiplexNetwork");
 	ERR_FAIL_COND_V_MSG(
-			this->target_peer != 0 &&
+			this->target_peer > 0 &&
 					!this->network->is_peer_connected(this->target_peer),
 			ERR_UNAVAILABLE,
 			"No known route to peer");
@@ -59,13 +59,15 @@ Error MultiplexPeer::_put_packet(const uint8_t *p_buffer, int32_t p_buffer_size)
 	packet->contents.data.mux_peer_source = this->_get_unique_id();
 	packet->contents.data.mux_peer_dest = this->target_peer;
 	packet->contents.data.length = p_buffer_size;
-  packet->contents.data.data = (uint8_t*)malloc(p_buffer_size);
-	memcpy(packet->contents.data.data, p_buffer, p_buffer_size);
+	// The only copy of the payload on the way to local subpeers, every recipient shares it
+	packet->payload.resize(p_buffer_size);
+	memcpy(packet->payload.ptrw(), p_buffer, p_buffer_size);
 	return network->send(packet, target_peer, current_channel, current_transfer_mode);
 }
 void MultiplexPeer::_poll() {
   //printf("MUXNET - PEER - %d poll called\n", unique_id);
-  if (network->host_peer->get_unique_id() == 1 && get_connection_status() == CONNECTION_CONNECTING) {
+  if (get_connection_status() == CONNECTION_CONNECTING && network->session.connects_locally()) {
+    // Subpeers next to the server connect without a round trip, offline that is every subpeer
     complete_connection();
   }
 	this->network->poll();
@@ -75,9 +77,8 @@ int32_t MultiplexPeer::_get_available_packet_count() const {
 }
 
 int32_t MultiplexPeer::_get_max_packet_size() const {
-	return this->network.is_null()						? 0
-			: this->network->_get_host_peer().is_null() ? 0
-														: MAX_MULTIPLEX_PACKET_SIZE;
+	// Offline packets never leave memory, they are capped the same so a game behaves the same online
+	return this->network.is_null() ? 0 : MAX_MULTIPLEX_PACKET_SIZE;
 }
 
 int32_t MultiplexPeer::_get_packet_channel() const {
@@ -113,43 +114,38 @@ int32_t MultiplexPeer::_get_packet_peer() const {
 }
 
 void MultiplexPeer::_close() {
-  printf("MUXNET - Closing peer %d", get_unique_id());
+  printf("MUXNET - Closing peer %d\n", get_unique_id());
 	if (this->active_mode == MODE_NONE) {
 		return;
 	}
 	incoming_packets.clear();
 	this->active_mode = MODE_NONE;
-  
-  if (unique_id == 1) {
-    for (auto e = network->internal_peers.begin(); e != network->internal_peers.end(); ++e) {
-      emit_signal("peer_disconnected", e->key);
-      e->value->emit_signal("peer_disconnected", 1);
-      e->value->close();
+  connection_status = CONNECTION_DISCONNECTED;
+  // The session tells everyone who has to know, then this peer is forgotten. Closing subpeer 1 ends the session
+  // and closes every other local subpeer.
+  network->session.close_local_subpeer(unique_id);
+  network->internal_peers.erase(unique_id);
+  if (unique_id == 1 && network->demux.is_valid()) {
+    // other sessions may still be using a shared host peer
+    if (network->demux->is_shared()) {
+      network->demux->_detach_network(network.ptr());
+      network->_detach();
     }
-    for (auto e = network->external_peers.begin(); e != network->external_peers.end(); ++e) {
-      emit_signal("peer_disconnected", e->key);
+    else {
+      network->host->close();
     }
-    network->host_peer->close();
-  }
-  else {
-	  this->network->send_command(MUX_CMD_REMOVE_PEER, this->_get_unique_id(), 1);
-    emit_signal("peer_disconnected", 1);
-    
   }
-  this->network->internal_peers.erase(get_unique_id());
-  connection_status = CONNECTION_DISCONNECTED;
 }
 
 void MultiplexPeer::_disconnect_peer(int32_t p_peer, bool p_force) {
-  if (this->network->external_peers.has(p_peer)) {
+  if (this->network->session.is_remote_subpeer(p_peer)) {
     if (p_peer == 1) {
       // If the server disconnected from us then we should probably close.
       this->close();
     }
     else if (unique_id == 1) {
-      // If we're the server, tell the client to remove the subpeer, and remove it from our known external peers.
-      this->network->send_command(MUX_CMD_REMOVE_PEER, p_peer, this->network->external_peers.get(p_peer));
-      this->network->external_peers.erase(p_peer);
+      // If we're the server, tell the client to remove the subpeer, and forget it
+      this->network->session.kick_subpeer(p_peer);
     }
   }
   if (!p_force) {
@@ -170,8 +166,15 @@ MultiplayerPeer::TransferMode MultiplexPeer::_get_packet_mode() const {
 
 bool MultiplexPeer::_is_server_relay_supported() const {
 	ERR_FAIL_COND_V_MSG(this->network.is_null(), 0, "MultiplexPeer has no associated network.");
-	ERR_FAIL_COND_V_MSG(this->network->_get_host_peer().is_null(), 0, "MultiplexNetwork has no host_peer");
-	return this->network->_get_host_peer()->is_server_relay_supported();
+	if (this->network->is_header_forwarding()) {
+		// Subpeers address each other directly and the MultiplexNetwork forwards their packets
+		return false;
+	}
+	if (this->network->is_offline()) {
+		// Relaying through subpeer 1 is only a few queue pushes
+		return true;
+	}
+	return this->network->host->is_server_relay_supported();
 }
 
 Error MultiplexPeer::_put_multiplex_packet_direct(Ref<MultiplexPacket> packet) {
@@ -194,12 +197,6 @@ void MultiplexPeer::_bind_methods() {
 }
 
 void MultiplexPeer::complete_connection() {
-  connection_status = CONNECTION_CONNECTED;
-  if (unique_id != 1) {
-    emit_signal("peer_connected", 1);
-    if (network->internal_peers.has(1)) {
-      network->internal_peers.get(1)->emit_signal("peer_connected", unique_id);
-    }
-  }
+  // the session marks it connected and tells the other subpeers
+  network->session.connect_local_subpeer(unique_id);
 }
-
@@ -7,8 +7,6 @@
 #include <godot_cpp/classes/multiplayer_peer_extension.hpp>
 #include <godot_cpp/templates/hash_map.hpp>
 using namespace godot;
-// size of a steam packet minus some overhead.
-#define MAX_MULTIPLEX_PACKET_SIZE 522288
 // MultiplexPeer wraps other Peers to allow for multiple virtual connections by decorating the packets
 // with only one actual network peer in the tree
 /*
@@ -7,6 +7,7 @@
 #include <godot_cpp/core/defs.hpp>
 #include <godot_cpp/godot.hpp>
 
+#include "multiplex_demux.h"
 #include "multiplex_peer.h"
 #include "multiplex_packet.h"
 
@@ -16,6 +17,7 @@ void initialize_multiplex_peer(ModuleInitializationLevel level) {
 	if (level == MODULE_INITIALIZATION_LEVEL_SCENE) {
     ClassDB::register_class<MultiplexPeer>();
     ClassDB::register_class<MultiplexNetwork>();
+    ClassDB::register_class<MultiplexDemux>();
     ClassDB::register_class<MultiplexPacket>();
 	}
 }